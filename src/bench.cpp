@@ -0,0 +1,687 @@
+
+#include <blaster/raster.h>
+#include <blaster/vector.h>
+#include <blaster/vbo.h>
+#include <blaster/time.h>
+
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+#include <tiny_gltf.h>
+
+#include "loader.h"
+#include "render.h"
+#include "profile.h"
+#include "tune.h"
+#include "scene.h"
+#include "memory.h"
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+
+using namespace std;
+
+struct FrameTime
+{
+    double clear;
+    double draw;
+    double update;
+    double hiz;
+    double total;
+
+    DrawStats stats;
+
+    // phases and worker times, for percentiles and traces
+    FrameRecord record;
+};
+
+struct BenchOptions
+{
+    const char* filename = nullptr;
+    const char* scene = nullptr;
+    const char* output = nullptr;
+    const char* trace = nullptr;
+    bool csv = false;
+    int width = 1920;
+    int height = 1080;
+    int frames = 600;
+    int warmup = 60;
+    WorkerConfig workers;
+    bool tune = false;
+    bool mips = true;
+    bool occlusion = false;
+
+    // regression check against a baseline file, threshold as a fraction
+    const char* baseline = nullptr;
+    const char* write_baseline = nullptr;
+    float threshold = 0.1f;
+
+    BuildOptions build;
+
+    // de-indexed vbo size of the model
+    size_t vbo_bytes = 0;
+
+    // unique vertices stored as Vertex and as QuantizedVertex
+    size_t float_vertex_bytes = 0;
+    size_t quantized_vertex_bytes = 0;
+};
+
+void usage()
+{
+    cerr<<"usage: blaster-bench [options] model.gltf|model.glb|model.obj"<<endl;
+    cerr<<"       blaster-bench [options] --scene spheres:T|overdraw:L|tiny:T|textured-quad:S"<<endl;
+    cerr<<"  --frames N        measured frames (600)"<<endl;
+    cerr<<"  --warmup N        frames rendered before measuring (60)"<<endl;
+    cerr<<"  --size WxH        raster size (1920x1080)"<<endl;
+    cerr<<"  --workers D,U     draw and update workers, or auto ($BLASTER_WORKERS, 3,1)"<<endl;
+    cerr<<"  --meshlets        split primitives into culled meshlets"<<endl;
+    cerr<<"  --lod             build and select simplified levels"<<endl;
+    cerr<<"  --quantize        keep vertices in the 16 byte format, decoded for VBOs"<<endl;
+    cerr<<"  --occlusion       cull against the previous frame's depth pyramid"<<endl;
+    cerr<<"  --no-mips         sample glTF textures at full size only"<<endl;
+    cerr<<"  --csv             write csv instead of json"<<endl;
+    cerr<<"  --output FILE     write results to FILE instead of stdout"<<endl;
+    cerr<<"  --trace FILE      write a chrome trace of the measured frames"<<endl;
+    cerr<<"  --scene NAME      render a procedural scene with a fixed camera"<<endl;
+    cerr<<"  --baseline FILE   fail when slower than the FILE entry of this run,"<<endl;
+    cerr<<"                    record this run as the entry when there is none"<<endl;
+    cerr<<"  --threshold F     allowed slowdown against the baseline (0.1)"<<endl;
+    cerr<<"  --write-baseline FILE  store this run as the FILE entry"<<endl;
+}
+
+bool parse_options(BenchOptions& options,int argc,char* argv[])
+{
+    for (int n=1;n<argc;n++) {
+        string arg = argv[n];
+        bool has_value = (n+1)<argc;
+
+        if (arg=="--frames" and has_value) {
+            options.frames = atoi(argv[++n]);
+        }
+        else if (arg=="--warmup" and has_value) {
+            options.warmup = atoi(argv[++n]);
+        }
+        else if (arg=="--size" and has_value) {
+            if (sscanf(argv[++n],"%dx%d",&options.width,&options.height)!=2) {
+                return false;
+            }
+        }
+        else if (arg=="--workers" and has_value) {
+            options.tune = (string(argv[++n])=="auto");
+
+            if (!options.tune and !parse_worker_config(argv[n],options.workers)) {
+                return false;
+            }
+        }
+        else if (arg=="--meshlets") {
+            options.build.meshlets = true;
+        }
+        else if (arg=="--lod") {
+            options.build.lods = true;
+        }
+        else if (arg=="--quantize") {
+            options.build.quantize = true;
+        }
+        else if (arg=="--occlusion") {
+            options.occlusion = true;
+        }
+        else if (arg=="--no-mips") {
+            options.mips = false;
+        }
+        else if (arg=="--csv") {
+            options.csv = true;
+        }
+        else if (arg=="--output" and has_value) {
+            options.output = argv[++n];
+        }
+        else if (arg=="--trace" and has_value) {
+            options.trace = argv[++n];
+        }
+        else if (arg=="--scene" and has_value) {
+            options.scene = argv[++n];
+        }
+        else if (arg=="--baseline" and has_value) {
+            options.baseline = argv[++n];
+        }
+        else if (arg=="--write-baseline" and has_value) {
+            options.write_baseline = argv[++n];
+        }
+        else if (arg=="--threshold" and has_value) {
+            options.threshold = atof(argv[++n]);
+        }
+        else if (arg[0]!='-' and options.filename==nullptr) {
+            options.filename = argv[n];
+        }
+        else {
+            return false;
+        }
+    }
+
+    return (options.filename!=nullptr)!=(options.scene!=nullptr) and options.frames>0 and options.warmup>=0
+           and options.width>0 and options.height>0;
+}
+
+/*
+    Camera path only depends on frame number, so every run (and every build)
+    renders exactly the same sequence of images: one full turn around the
+    model while dollying between near and far distance. Procedural scenes
+    are framed for a camera that stays 30 units away instead.
+*/
+View camera_view(int frame,int frames,int width,int height,bool orbit)
+{
+    if (!orbit) {
+        frame = 0;
+    }
+
+    float t = frame/(float)frames;
+    float angle = t * 2.0f * M_PI;
+    float Z = orbit ? -30.0f + 15.0f * sinf(t * 4.0f * M_PI) : -30.0f;
+    float aspect = width/(float)height;
+
+    glm::mat4 mprojection = glm::frustum(-aspect,aspect,1.0f,-1.0f,1.0f,1000.0f);
+
+    glm::mat4 mmodel(1.0f);
+    mmodel = glm::translate(mmodel,glm::vec3(0.0f,0.0f,Z));
+    mmodel = glm::rotate(mmodel,angle,glm::vec3(0.0f,1.0f,0.0f));
+
+    return make_view(mprojection,mmodel,height);
+}
+
+View setup_camera(bl_raster_t* raster,int frame,int frames,int width,int height,bool orbit)
+{
+    View view = camera_view(frame,frames,width,height,orbit);
+
+    bl_vector_t light_pos = {0.0f,1.0f,4.0f,0.0f};
+    bl_vector_normalize(&light_pos);
+    bl_raster_uniform_set_vector(raster,2,&light_pos);
+
+    return view;
+}
+
+// hiz is null without occlusion culling, otherwise rebuilt after every frame
+FrameTime render_frame(bl_raster_t* raster,Profiler& profiler,HiZ* hiz,vector<Primitive*>& primitives,int frame,int frames,int width,int height,bool orbit)
+{
+    FrameTime ft;
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    raster->start=bl_time_us();
+    ft.record.raster_start = profiler_now(profiler);
+    bl_raster_clear(raster);
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    View view = setup_camera(raster,frame,frames,width,height,orbit);
+    view.hiz = hiz;
+
+    draw_primitives(raster,primitives,view,ft.stats);
+
+    raster->main=bl_time_us();
+    bl_raster_flush_draw(raster);
+
+    auto t2 = std::chrono::steady_clock::now();
+
+    bl_raster_flush_update(raster);
+
+    auto t3 = std::chrono::steady_clock::now();
+
+    if (hiz) {
+        build_hiz(*hiz,raster,width,height,view.viewport*view.mvp);
+    }
+
+    auto t4 = std::chrono::steady_clock::now();
+
+    ft.clear = std::chrono::duration_cast<std::chrono::microseconds>(t1-t0).count();
+    ft.draw = std::chrono::duration_cast<std::chrono::microseconds>(t2-t1).count();
+    ft.update = std::chrono::duration_cast<std::chrono::microseconds>(t3-t2).count();
+    ft.hiz = std::chrono::duration_cast<std::chrono::microseconds>(t4-t3).count();
+    ft.total = std::chrono::duration_cast<std::chrono::microseconds>(t4-t0).count();
+
+    ft.record.start = profiler_time(profiler,t0);
+    ft.record.end = profiler_time(profiler,t4);
+    record_phase(ft.record,PHASE_CLEAR,ft.record.start,profiler_time(profiler,t1));
+    record_phase(ft.record,PHASE_DRAW,profiler_time(profiler,t1),profiler_time(profiler,t2));
+    record_phase(ft.record,PHASE_UPDATE,profiler_time(profiler,t2),profiler_time(profiler,t3));
+
+    record_workers(ft.record,raster);
+
+    return ft;
+}
+
+void write_csv(ostream& os,vector<FrameTime>& frames)
+{
+    os<<"frame,clear_us,draw_us,update_us,total_us,triangles_drawn,triangles_culled";
+
+    if (frames.size()>0) {
+        for (size_t n=0;n<frames[0].record.workers.size();n++) {
+            os<<",w"<<n<<"_type,w"<<n<<"_wait_us,w"<<n<<"_work_us,w"<<n<<"_start_us,w"<<n<<"_last_us";
+        }
+    }
+
+    os<<endl;
+
+    for (size_t f=0;f<frames.size();f++) {
+        FrameTime& ft = frames[f];
+
+        os<<f<<","<<ft.clear<<","<<ft.draw<<","<<ft.update<<","<<ft.total
+          <<","<<ft.stats.triangles_drawn<<","<<ft.stats.triangles_culled;
+
+        for (WorkerTime& wt : ft.record.workers) {
+            os<<","<<wt.type<<","<<wt.wait<<","<<wt.work<<","<<wt.start<<","<<wt.last;
+        }
+
+        os<<endl;
+    }
+}
+
+// throughput of a run, the values kept in baseline files
+struct BenchResult
+{
+    double p50_us = 0;
+    double triangles_per_s = 0;
+    double pixels_per_s = 0;
+};
+
+BenchResult summarize(BenchOptions& options,vector<FrameTime>& frames,float depth_complexity)
+{
+    BenchResult result;
+
+    double sum_total = 0;
+    double sum_triangles = 0;
+    vector<double> totals;
+
+    for (FrameTime& ft : frames) {
+        sum_total+=ft.total;
+        sum_triangles+=ft.stats.triangles_drawn;
+        totals.push_back(ft.total);
+    }
+
+    double seconds = sum_total/1000000.0;
+
+    result.p50_us = compute_percentiles(totals).p50;
+    result.triangles_per_s = sum_triangles/seconds;
+    result.pixels_per_s = options.width*(double)options.height*depth_complexity*frames.size()/seconds;
+
+    return result;
+}
+
+// scene or model, plus raster size, one baseline entry each
+string baseline_key(BenchOptions& options)
+{
+    ostringstream key;
+    key<<(options.scene ? options.scene : options.filename)<<"@"<<options.width<<"x"<<options.height;
+
+    return key.str();
+}
+
+// lines of key p50_us triangles_per_s pixels_per_s, # starts a comment
+map<string,BenchResult> read_baseline(const char* path)
+{
+    map<string,BenchResult> entries;
+    ifstream fs(path);
+    string line;
+
+    while (getline(fs,line)) {
+        if (line.empty() or line[0]=='#') {
+            continue;
+        }
+
+        istringstream ls(line);
+        string key;
+        BenchResult result;
+
+        if (ls>>key>>result.p50_us>>result.triangles_per_s>>result.pixels_per_s) {
+            entries[key] = result;
+        }
+    }
+
+    return entries;
+}
+
+// comment lines are kept, entries come out sorted by key
+bool write_baseline(const char* path,const string& key,const BenchResult& result)
+{
+    map<string,BenchResult> entries = read_baseline(path);
+    entries[key] = result;
+
+    vector<string> comments;
+    ifstream in(path);
+    string line;
+
+    while (getline(in,line)) {
+        if (!line.empty() and line[0]=='#') {
+            comments.push_back(line);
+        }
+    }
+
+    in.close();
+
+    if (comments.empty()) {
+        comments.push_back("# blaster-bench baseline: key p50_us triangles_per_s pixels_per_s");
+    }
+
+    ofstream fs(path);
+
+    if (!fs.is_open()) {
+        return false;
+    }
+
+    for (const string& comment : comments) {
+        fs<<comment<<endl;
+    }
+
+    for (auto& entry : entries) {
+        fs<<entry.first<<" "<<entry.second.p50_us<<" "<<entry.second.triangles_per_s<<" "<<entry.second.pixels_per_s<<endl;
+    }
+
+    return !fs.fail();
+}
+
+// false when any metric is worse than baseline by more than threshold
+bool check_baseline(const BenchResult& baseline,const BenchResult& result,float threshold)
+{
+    struct Metric {
+        const char* name;
+        double base;
+        double value;
+        bool lower_is_better;
+    };
+
+    Metric metrics[3] = {
+        {"p50 frame time",baseline.p50_us,result.p50_us,true},
+        {"triangles/s",baseline.triangles_per_s,result.triangles_per_s,false},
+        {"pixels/s",baseline.pixels_per_s,result.pixels_per_s,false}
+    };
+
+    bool pass = true;
+
+    for (Metric& m : metrics) {
+        if (m.base<=0) {
+            continue;
+        }
+
+        double change = (m.value-m.base)/m.base;
+        bool regressed = m.lower_is_better ? change>threshold : -change>threshold;
+
+        clog<<m.name<<": "<<m.value<<" (baseline "<<m.base<<", "<<(change>=0 ? "+" : "")<<change*100.0<<"%)"<<(regressed ? " REGRESSION" : "")<<endl;
+
+        pass = pass and !regressed;
+    }
+
+    return pass;
+}
+
+void write_json(ostream& os,BenchOptions& options,vector<FrameTime>& frames,const BenchResult& result)
+{
+    double sum_clear=0;
+    double sum_draw=0;
+    double sum_update=0;
+    double sum_hiz=0;
+    double sum_total=0;
+    double min_total=frames[0].total;
+    double max_total=frames[0].total;
+
+    for (FrameTime& ft : frames) {
+        sum_clear+=ft.clear;
+        sum_draw+=ft.draw;
+        sum_update+=ft.update;
+        sum_hiz+=ft.hiz;
+        sum_total+=ft.total;
+
+        if (ft.total<min_total) {
+            min_total=ft.total;
+        }
+
+        if (ft.total>max_total) {
+            max_total=ft.total;
+        }
+    }
+
+    double count = frames.size();
+
+    vector<double> totals;
+
+    for (FrameTime& ft : frames) {
+        totals.push_back(ft.total);
+    }
+
+    Percentiles total = compute_percentiles(totals);
+
+    os<<"{"<<endl;
+    os<<"  \""<<(options.scene ? "scene" : "model")<<"\": \""<<(options.scene ? options.scene : options.filename)<<"\","<<endl;
+    os<<"  \"width\": "<<options.width<<","<<endl;
+    os<<"  \"height\": "<<options.height<<","<<endl;
+    os<<"  \"draw_workers\": "<<options.workers.draw_workers<<","<<endl;
+    os<<"  \"update_workers\": "<<options.workers.update_workers<<","<<endl;
+    os<<"  \"tuned_workers\": "<<(options.tune ? "true" : "false")<<","<<endl;
+    os<<"  \"warmup\": "<<options.warmup<<","<<endl;
+    os<<"  \"meshlets\": "<<(options.build.meshlets ? "true" : "false")<<","<<endl;
+    os<<"  \"lods\": "<<(options.build.lods ? "true" : "false")<<","<<endl;
+    os<<"  \"occlusion\": "<<(options.occlusion ? "true" : "false")<<","<<endl;
+    os<<"  \"mips\": "<<(options.mips ? "true" : "false")<<","<<endl;
+    os<<"  \"quantized\": "<<(options.build.quantize ? "true" : "false")<<","<<endl;
+    os<<"  \"vbo_bytes\": "<<options.vbo_bytes<<","<<endl;
+    os<<"  \"float_vertex_bytes\": "<<options.float_vertex_bytes<<","<<endl;
+    os<<"  \"quantized_vertex_bytes\": "<<options.quantized_vertex_bytes<<","<<endl;
+    os<<"  \"summary\": {"
+      <<"\"clear_us\": "<<sum_clear/count<<", "
+      <<"\"draw_us\": "<<sum_draw/count<<", "
+      <<"\"update_us\": "<<sum_update/count<<", "
+      <<"\"hiz_us\": "<<sum_hiz/count<<", "
+      <<"\"total_us\": "<<sum_total/count<<", "
+      <<"\"min_total_us\": "<<min_total<<", "
+      <<"\"max_total_us\": "<<max_total<<", "
+      <<"\"p50_total_us\": "<<total.p50<<", "
+      <<"\"p95_total_us\": "<<total.p95<<", "
+      <<"\"p99_total_us\": "<<total.p99<<", "
+      <<"\"triangles_per_s\": "<<result.triangles_per_s<<", "
+      <<"\"pixels_per_s\": "<<result.pixels_per_s<<", "
+      <<"\"fps\": "<<1000000.0*count/sum_total<<"},"<<endl;
+    os<<"  \"frames\": ["<<endl;
+
+    for (size_t f=0;f<frames.size();f++) {
+        FrameTime& ft = frames[f];
+
+        os<<"    {\"frame\": "<<f
+          <<", \"clear_us\": "<<ft.clear
+          <<", \"draw_us\": "<<ft.draw
+          <<", \"update_us\": "<<ft.update
+          <<", \"total_us\": "<<ft.total
+          <<", \"triangles_drawn\": "<<ft.stats.triangles_drawn
+          <<", \"triangles_culled\": "<<ft.stats.triangles_culled
+          <<", \"triangles_simplified\": "<<ft.stats.triangles_simplified
+          <<", \"instances_drawn\": "<<ft.stats.instances_drawn
+          <<", \"draw_calls\": "<<ft.stats.draw_calls
+          <<", \"state_flushes\": "<<ft.stats.state_flushes
+          <<", \"instances_occluded\": "<<ft.stats.instances_occluded
+          <<", \"meshlets_occluded\": "<<ft.stats.meshlets_occluded
+          <<", \"workers\": [";
+
+        for (size_t n=0;n<ft.record.workers.size();n++) {
+            WorkerTime& wt = ft.record.workers[n];
+
+            os<<(n>0 ? ", " : "")
+              <<"{\"type\": "<<wt.type
+              <<", \"wait_us\": "<<wt.wait
+              <<", \"work_us\": "<<wt.work
+              <<", \"start_us\": "<<wt.start
+              <<", \"last_us\": "<<wt.last<<"}";
+        }
+
+        os<<"]}"<<(f+1<frames.size() ? "," : "")<<endl;
+    }
+
+    os<<"  ]"<<endl;
+    os<<"}"<<endl;
+}
+
+int main(int argc,char* argv[])
+{
+    BenchOptions options;
+    options.workers = default_worker_config(options.tune);
+
+    if (!parse_options(options,argc,argv)) {
+        usage();
+        return -1;
+    }
+
+    clog<<"Blaster-bench"<<endl;
+
+    vector<Primitive*> primitives;
+    vector<MipTexture*> textures;
+    Profiler profiler;
+
+    float depth_complexity = 1.0f;
+
+    if (options.scene) {
+        Scene scene;
+
+        if (!build_scene(options.scene,scene,options.build)) {
+            return -1;
+        }
+
+        primitives = scene.primitives;
+        textures = scene.textures;
+        depth_complexity = scene.depth_complexity;
+    }
+    else if (!load_primitives(options.filename,primitives,options.build,&textures)) {
+        cerr<<"Failed to load gltf file"<<endl;
+        return -1;
+    }
+
+    bool orbit = options.scene==nullptr;
+
+    options.vbo_bytes = vbo_bytes(primitives,sizeof(Vertex));
+    options.float_vertex_bytes = vertex_bytes(primitives,sizeof(Vertex));
+    options.quantized_vertex_bytes = vertex_bytes(primitives,sizeof(QuantizedVertex));
+
+    if (options.tune) {
+        options.workers = tune_workers(options.width,options.height,primitives,camera_view(0,options.frames,options.width,options.height,orbit));
+    }
+
+    clog<<"workers: "<<options.workers.draw_workers<<" draw, "<<options.workers.update_workers<<" update"<<(options.tune ? " (auto)" : "")<<endl;
+
+    bl_raster_t* raster = bl_raster_new(options.width,options.height,options.workers.draw_workers,options.workers.update_workers);
+
+    bl_color_t clear_color;
+    bl_color_set(&clear_color,0.9,0.9,0.9,1.0);
+    bl_raster_set_clear_color(raster,&clear_color);
+
+    for (MipTexture* texture : textures) {
+        if (texture) {
+            if (!options.mips) {
+                texture->levels.resize(1);
+            }
+
+            upload_texture(*texture,raster->color_buffer->type);
+        }
+    }
+
+    HiZ hiz;
+    HiZ* occlusion = options.occlusion ? &hiz : nullptr;
+
+    for (int n=0;n<options.warmup;n++) {
+        render_frame(raster,profiler,occlusion,primitives,n,options.frames,options.width,options.height,orbit);
+    }
+
+    MemoryReport memory;
+    memory.vbos = allocated_vbo_bytes(primitives);
+    memory.meshes = mesh_bytes(primitives);
+    memory.textures = texture_bytes(textures);
+    memory.color_buffers = (size_t)options.width*options.height*sizeof(uint32_t);
+    memory.depth_buffer = (size_t)options.width*options.height*sizeof(uint16_t);
+    memory.scratch = hiz_bytes(hiz);
+
+    print_memory_report(memory);
+
+    vector<FrameTime> frames;
+    frames.reserve(options.frames);
+
+    for (int n=0;n<options.frames;n++) {
+        frames.push_back(render_frame(raster,profiler,occlusion,primitives,n,options.frames,options.width,options.height,orbit));
+    }
+
+    bl_raster_delete(raster);
+
+    for (MipTexture* texture : textures) {
+        if (texture) {
+            delete_texture(texture);
+        }
+    }
+
+    ofstream fs;
+    ostream* os = &cout;
+
+    if (options.output) {
+        fs.open(options.output,fstream::out);
+
+        if (!fs.is_open()) {
+            cerr<<"Failed to open "<<options.output<<endl;
+            return -1;
+        }
+
+        os = &fs;
+    }
+
+    BenchResult result = summarize(options,frames,depth_complexity);
+
+    if (options.csv) {
+        write_csv(*os,frames);
+    }
+    else {
+        write_json(*os,options,frames,result);
+    }
+
+    if (options.trace) {
+        vector<FrameRecord> records;
+
+        for (FrameTime& ft : frames) {
+            records.push_back(ft.record);
+        }
+
+        if (!write_trace(options.trace,records)) {
+            cerr<<"Failed to write trace "<<options.trace<<endl;
+        }
+    }
+
+    clog<<"frames: "<<frames.size()<<endl;
+
+    string key = baseline_key(options);
+
+    if (options.write_baseline) {
+        if (!write_baseline(options.write_baseline,key,result)) {
+            cerr<<"Failed to write baseline "<<options.write_baseline<<endl;
+            return -1;
+        }
+
+        clog<<"Stored baseline "<<key<<" in "<<options.write_baseline<<endl;
+    }
+
+    if (options.baseline) {
+        map<string,BenchResult> entries = read_baseline(options.baseline);
+        auto it = entries.find(key);
+
+        // the first run on a machine becomes the reference of the next ones
+        if (it==entries.end()) {
+            if (!write_baseline(options.baseline,key,result)) {
+                cerr<<"No baseline for "<<key<<" and failed to record it in "<<options.baseline<<endl;
+                return 1;
+            }
+
+            clog<<"No baseline for "<<key<<", recorded this run in "<<options.baseline<<endl;
+        }
+        else if (!check_baseline(it->second,result,options.threshold)) {
+            cerr<<"Regression beyond "<<options.threshold*100.0<<"% against "<<options.baseline<<endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
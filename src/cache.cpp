@@ -0,0 +1,595 @@
+#include "cache.h"
+#include "mapped.h"
+#include "layout.h"
+#include "pool.h"
+
+#include <sys/stat.h>
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+using namespace std;
+
+#define MESH_CACHE_MAGIC 0x434d4c42 // BLMC
+#define MESH_CACHE_VERSION 7
+
+// header flags
+#define MESH_CACHE_LODS 1
+#define MESH_CACHE_QUANTIZED 2
+#define MESH_CACHE_MESHLETS 4
+#define MESH_CACHE_PACKED 8
+
+struct CacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;
+    uint32_t primitives;
+    uint32_t vertex_size;
+    uint32_t cache_size;
+    uint32_t flags;
+};
+
+/*
+    Each entry points at its sections, every one starting on 16 bytes:
+    vertices, indices, CacheLod table, CacheMeshlet table, instance
+    transforms, then the VBO contents, the primitive or meshlet ones
+    followed by the lod ones
+*/
+struct CacheEntry
+{
+    uint64_t vertices;
+    uint64_t indices;
+    uint64_t cache_misses;
+    uint64_t lods;
+    uint64_t meshlets;
+    uint64_t instances;
+    int64_t texture;
+    uint64_t offset;
+
+    // of the packed vertices, with MESH_CACHE_PACKED
+    Quantization quantization;
+
+    Bounds bounds;
+    float uv_density;
+    uint32_t pad;
+};
+
+// indices is the vertex count of the lod VBO
+struct CacheLod
+{
+    uint64_t indices;
+    uint64_t cache_misses;
+    float error;
+    uint32_t pad;
+};
+
+struct CacheMeshlet
+{
+    uint32_t first;
+    uint32_t count;
+    uint32_t vertex_count;
+
+    glm::vec3 center;
+    float radius;
+
+    glm::vec3 cone_axis;
+    float cone_cutoff;
+};
+
+// the vertices setup_primitive keeps, stored as they are
+static bool packed_vertices(const BuildOptions& options)
+{
+    return options.quantize or options.release_vertices;
+}
+
+static size_t stored_vertex_size(const BuildOptions& options)
+{
+    return packed_vertices(options) ? sizeof(QuantizedVertex) : sizeof(Vertex);
+}
+
+static size_t align16(size_t value)
+{
+    return (value+15) & ~(size_t)15;
+}
+
+// count elements of size bytes fit between offset and the end of the file
+static bool fits(size_t offset,uint64_t count,size_t size,size_t file_size)
+{
+    return offset<=file_size and count<=(file_size-offset)/size;
+}
+
+// end of a section of count elements of size bytes placed after offset
+static size_t place(size_t offset,uint64_t count,size_t size)
+{
+    return align16(offset) + count*size;
+}
+
+// places a section like place, false when it does not fit in the file
+static bool place_checked(size_t& offset,uint64_t count,size_t size,size_t file_size,size_t& start)
+{
+    start = align16(offset);
+
+    if (!fits(start,count,size,file_size)) {
+        return false;
+    }
+
+    offset = start + count*size;
+    return true;
+}
+
+static bool indices_in_range(const uint32_t* indices,uint64_t count,uint64_t vertices)
+{
+    for (uint64_t n=0;n<count;n++) {
+        if (indices[n]>=vertices) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// meshlets have to cover the indices in order, like build_meshlets leaves them
+static bool meshlets_valid(const CacheMeshlet* meshlets,uint64_t count,uint64_t indices)
+{
+    uint64_t first = 0;
+
+    for (uint64_t n=0;n<count;n++) {
+        if (meshlets[n].first!=first or meshlets[n].count%3!=0 or meshlets[n].count>indices-first) {
+            return false;
+        }
+
+        first+=meshlets[n].count;
+    }
+
+    return count==0 or first==indices;
+}
+
+// new VBO holding the next count vertices, returns the ones after them
+static const Vertex* read_vbo(bl_vbo_t*& vbo,const Vertex* vertices,size_t count)
+{
+    vbo = new_vbo<TriangleLayout>(count);
+    write_vbo<TriangleLayout>(vbo,0,vertices,count);
+
+    return vertices+count;
+}
+
+static void read_vbos(Primitive* prim,const Vertex* vertices,const BuildOptions& options)
+{
+    if (options.meshlets) {
+        for (Meshlet& meshlet : prim->meshlets) {
+            vertices = read_vbo(meshlet.vbo,vertices,meshlet.count);
+        }
+    }
+    else {
+        vertices = read_vbo(prim->vbo,vertices,prim->index_count);
+    }
+
+    for (Lod& lod : prim->lods) {
+        vertices = read_vbo(lod.vbo,vertices,lod.index_count);
+    }
+}
+
+static void write_bytes(fstream& fs,size_t& pos,const void* data,size_t bytes)
+{
+    fs.write((const char*)data,bytes);
+    pos+=bytes;
+}
+
+// pads to the next 16 bytes first, like place
+static void write_section(fstream& fs,size_t& pos,const void* data,size_t bytes)
+{
+    const char zero[16] = {0};
+
+    write_bytes(fs,pos,zero,align16(pos)-pos);
+    write_bytes(fs,pos,data,bytes);
+}
+
+static uint64_t hash_word(uint64_t h,uint64_t w)
+{
+    h = (h ^ w) * 0xff51afd7ed558ccdULL;
+    return h ^ (h>>32);
+}
+
+uint64_t hash_file(const char* filename)
+{
+    MappedFile file;
+
+    if (!file.open(filename)) {
+        return 0;
+    }
+
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ file.size;
+    size_t words = file.size/8;
+
+    for (size_t n=0;n<words;n++) {
+        uint64_t w;
+        memcpy(&w,file.data+n*8,8);
+
+        h = hash_word(h,w);
+    }
+
+    for (size_t n=words*8;n<file.size;n++) {
+        h = (h ^ file.data[n]) * 0x100000001b3ULL;
+    }
+
+    return (h==0) ? 1 : h;
+}
+
+uint64_t hash_source(const char* filename,const vector<string>& side_files)
+{
+    uint64_t h = hash_file(filename);
+
+    if (h==0) {
+        return 0;
+    }
+
+    // side-car files can be large, their size and modification time stand in for the contents
+    for (const string& side : side_files) {
+        struct stat st;
+
+        if (stat(side.c_str(),&st)!=0) {
+            return 0;
+        }
+
+        for (char c : side) {
+            h = hash_word(h,(uint8_t)c);
+        }
+
+        h = hash_word(h,st.st_size);
+        h = hash_word(h,st.st_mtim.tv_sec);
+        h = hash_word(h,st.st_mtim.tv_nsec);
+    }
+
+    return (h==0) ? 1 : h;
+}
+
+string mesh_cache_path(uint64_t hash)
+{
+    string dir;
+
+    const char* env = getenv("BLASTER_CACHE_DIR");
+
+    if (env) {
+        dir = env;
+    }
+    else {
+        env = getenv("XDG_CACHE_HOME");
+
+        if (env) {
+            dir = string(env) + "/blaster-demo";
+        }
+        else {
+            env = getenv("HOME");
+            dir = string(env ? env : "/tmp") + "/.cache/blaster-demo";
+        }
+    }
+
+    // create every missing component, errors show up when saving
+    for (size_t n=1;n<=dir.size();n++) {
+        if (n==dir.size() or dir[n]=='/') {
+            mkdir(dir.substr(0,n).c_str(),0755);
+        }
+    }
+
+    char name[32];
+    snprintf(name,sizeof(name),"%016llx.blmc",(unsigned long long)hash);
+
+    return dir + "/" + name;
+}
+
+bool load_mesh_cache(const string& path,uint64_t hash,vector<Primitive*>& primitives,const BuildOptions& options)
+{
+    MappedFile file;
+
+    if (!file.open(path.c_str())) {
+        return false;
+    }
+
+    const CacheHeader* header = (const CacheHeader*)file.data;
+
+    if (file.size<sizeof(CacheHeader) or
+        header->magic!=MESH_CACHE_MAGIC or header->version!=MESH_CACHE_VERSION or
+        header->hash!=hash or header->vertex_size!=sizeof(Vertex) or
+        header->cache_size!=VERTEX_CACHE_SIZE) {
+        clog<<"Stale mesh cache: "<<path<<endl;
+        return false;
+    }
+
+    if (options.lods and !(header->flags & MESH_CACHE_LODS)) {
+        clog<<"Mesh cache has no lods: "<<path<<endl;
+        return false;
+    }
+
+    // the stored VBOs are either per meshlet or per primitive and hold
+    // decoded vertices when quantized, the unique vertices are packed when
+    // only those are kept
+    if (options.meshlets != ((header->flags & MESH_CACHE_MESHLETS)!=0) or
+        options.quantize != ((header->flags & MESH_CACHE_QUANTIZED)!=0) or
+        packed_vertices(options) != ((header->flags & MESH_CACHE_PACKED)!=0)) {
+        clog<<"Mesh cache vertex format differs: "<<path<<endl;
+        return false;
+    }
+
+    if (!fits(sizeof(CacheHeader),header->primitives,sizeof(CacheEntry),file.size)) {
+        clog<<"Truncated mesh cache: "<<path<<endl;
+        return false;
+    }
+
+    const CacheEntry* entries = (const CacheEntry*)(file.data + sizeof(CacheHeader));
+    size_t vertex_size = stored_vertex_size(options);
+
+    // start of the VBO contents of each primitive
+    vector<const Vertex*> vbo_data;
+
+    for (uint32_t n=0;n<header->primitives;n++) {
+        const CacheEntry& entry = entries[n];
+
+        // every count is checked against what is left of the file before
+        // it is used, so offsets never overflow or leave the mapping
+        size_t offset = entry.offset;
+        size_t vertex_offset = 0;
+        size_t index_offset = 0;
+        size_t lod_table = 0;
+        size_t meshlet_table = 0;
+        size_t instance_offset = 0;
+        size_t vbo_offset = 0;
+
+        bool valid = (offset%16)==0 and
+            place_checked(offset,entry.vertices,vertex_size,file.size,vertex_offset) and
+            place_checked(offset,entry.indices,sizeof(uint32_t),file.size,index_offset) and
+            place_checked(offset,entry.lods,sizeof(CacheLod),file.size,lod_table) and
+            place_checked(offset,entry.meshlets,sizeof(CacheMeshlet),file.size,meshlet_table) and
+            place_checked(offset,entry.instances,sizeof(glm::mat4),file.size,instance_offset);
+
+        const CacheLod* lods = (const CacheLod*)(file.data + lod_table);
+        const CacheMeshlet* meshlets = (const CacheMeshlet*)(file.data + meshlet_table);
+
+        // lod VBOs follow the primitive ones, whether they get used or not
+        uint64_t vbo_count = entry.indices;
+
+        for (uint64_t l=0;l<entry.lods and valid;l++) {
+            valid = lods[l].indices<=file.size and vbo_count<=file.size;
+            vbo_count+=lods[l].indices;
+        }
+
+        if (valid) {
+            valid = place_checked(offset,vbo_count,sizeof(Vertex),file.size,vbo_offset);
+        }
+
+        // indices are used to gather vertices without further checks
+        if (valid) {
+            valid = indices_in_range((const uint32_t*)(file.data + index_offset),entry.indices,entry.vertices);
+        }
+
+        if (valid and options.meshlets) {
+            valid = meshlets_valid(meshlets,entry.meshlets,entry.indices);
+        }
+
+        if (!valid) {
+            clog<<"Corrupt mesh cache: "<<path<<endl;
+
+            for (Primitive* prim : primitives) {
+                delete prim;
+            }
+
+            primitives.clear();
+            return false;
+        }
+
+        const uint8_t* vertices = file.data + vertex_offset;
+        const uint32_t* indices = (const uint32_t*)(file.data + index_offset);
+
+        Primitive* prim = new Primitive();
+
+        if (packed_vertices(options)) {
+            prim->packed.assign((const QuantizedVertex*)vertices,(const QuantizedVertex*)vertices+entry.vertices);
+            prim->quantization = entry.quantization;
+        }
+        else {
+            prim->vertices.assign((const Vertex*)vertices,(const Vertex*)vertices+entry.vertices);
+        }
+
+        prim->indices.assign(indices,indices+entry.indices);
+        prim->vertex_count = entry.vertices;
+        prim->index_count = entry.indices;
+        prim->cache_misses = entry.cache_misses;
+        prim->material_texture = entry.texture;
+        prim->bounds = entry.bounds;
+        prim->uv_density = entry.uv_density;
+
+        if (options.lods) {
+            for (uint64_t l=0;l<entry.lods;l++) {
+                Lod lod;
+
+                lod.index_count = lods[l].indices;
+                lod.cache_misses = lods[l].cache_misses;
+                lod.error = lods[l].error;
+                lod.vbo = nullptr;
+
+                prim->lods.push_back(lod);
+            }
+        }
+
+        if (options.meshlets) {
+            for (uint64_t m=0;m<entry.meshlets;m++) {
+                Meshlet meshlet;
+
+                meshlet.first = meshlets[m].first;
+                meshlet.count = meshlets[m].count;
+                meshlet.vertex_count = meshlets[m].vertex_count;
+                meshlet.center = meshlets[m].center;
+                meshlet.radius = meshlets[m].radius;
+                meshlet.cone_axis = meshlets[m].cone_axis;
+                meshlet.cone_cutoff = meshlets[m].cone_cutoff;
+                meshlet.vbo = nullptr;
+
+                prim->meshlets.push_back(meshlet);
+            }
+        }
+
+        const glm::mat4* transforms = (const glm::mat4*)(file.data + instance_offset);
+
+        for (uint64_t i=0;i<entry.instances;i++) {
+            Instance instance;
+            instance.transform = transforms[i];
+
+            prim->instances.push_back(instance);
+        }
+
+        primitives.push_back(prim);
+        vbo_data.push_back((const Vertex*)(file.data + vbo_offset));
+    }
+
+    // vbos are copied once the mapping is validated as a whole
+    parallel_for(build_pool(),primitives.size(),1,[&](size_t begin,size_t end) {
+        for (size_t n=begin;n<end;n++) {
+            read_vbos(primitives[n],vbo_data[n],options);
+        }
+    });
+
+    return true;
+}
+
+bool save_mesh_cache(const string& path,uint64_t hash,const vector<Primitive*>& primitives,const BuildOptions& options)
+{
+    string tmp = path + ".tmp";
+    fstream fs;
+
+    fs.open(tmp.c_str(),fstream::out | fstream::binary | fstream::trunc);
+
+    if (!fs.is_open()) {
+        return false;
+    }
+
+    CacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.hash = hash;
+    header.primitives = primitives.size();
+    header.vertex_size = sizeof(Vertex);
+    header.cache_size = VERTEX_CACHE_SIZE;
+
+    // small primitives have no lods even when they were built
+    if (options.lods) {
+        header.flags|=MESH_CACHE_LODS;
+    }
+
+    if (options.quantize) {
+        header.flags|=MESH_CACHE_QUANTIZED;
+    }
+
+    if (options.meshlets) {
+        header.flags|=MESH_CACHE_MESHLETS;
+    }
+
+    if (packed_vertices(options)) {
+        header.flags|=MESH_CACHE_PACKED;
+    }
+
+    fs.write((const char*)&header,sizeof(header));
+
+    size_t offset = align16(sizeof(CacheHeader) + primitives.size()*sizeof(CacheEntry));
+    size_t vertex_size = stored_vertex_size(options);
+
+    for (Primitive* prim : primitives) {
+        CacheEntry entry = {};
+        entry.vertices = prim->vertex_count;
+        entry.indices = prim->index_count;
+        entry.cache_misses = prim->cache_misses;
+        entry.lods = prim->lods.size();
+        entry.meshlets = prim->meshlets.size();
+        entry.instances = prim->instances.size();
+        entry.texture = prim->material_texture;
+        entry.offset = offset;
+        entry.quantization = prim->quantization;
+        entry.bounds = prim->bounds;
+        entry.uv_density = prim->uv_density;
+
+        fs.write((const char*)&entry,sizeof(entry));
+
+        size_t vbo_count = prim->index_count;
+
+        for (const Lod& lod : prim->lods) {
+            vbo_count+=lod.index_count;
+        }
+
+        offset = place(offset,entry.vertices,vertex_size);
+        offset = place(offset,entry.indices,sizeof(uint32_t));
+        offset = place(offset,entry.lods,sizeof(CacheLod));
+        offset = place(offset,entry.meshlets,sizeof(CacheMeshlet));
+        offset = place(offset,entry.instances,sizeof(glm::mat4));
+        offset = align16(place(offset,vbo_count,sizeof(Vertex)));
+    }
+
+    size_t pos = sizeof(CacheHeader) + primitives.size()*sizeof(CacheEntry);
+
+    for (Primitive* prim : primitives) {
+        const void* vertices = packed_vertices(options) ? (const void*)prim->packed.data() : (const void*)prim->vertices.data();
+
+        write_section(fs,pos,vertices,prim->vertex_count*vertex_size);
+        write_section(fs,pos,prim->indices.data(),prim->index_count*sizeof(uint32_t));
+
+        vector<CacheLod> lods(prim->lods.size(),CacheLod());
+
+        for (size_t l=0;l<lods.size();l++) {
+            lods[l].indices = prim->lods[l].index_count;
+            lods[l].cache_misses = prim->lods[l].cache_misses;
+            lods[l].error = prim->lods[l].error;
+        }
+
+        write_section(fs,pos,lods.data(),lods.size()*sizeof(CacheLod));
+
+        vector<CacheMeshlet> meshlets(prim->meshlets.size());
+
+        for (size_t m=0;m<meshlets.size();m++) {
+            const Meshlet& meshlet = prim->meshlets[m];
+
+            meshlets[m].first = meshlet.first;
+            meshlets[m].count = meshlet.count;
+            meshlets[m].vertex_count = meshlet.vertex_count;
+            meshlets[m].center = meshlet.center;
+            meshlets[m].radius = meshlet.radius;
+            meshlets[m].cone_axis = meshlet.cone_axis;
+            meshlets[m].cone_cutoff = meshlet.cone_cutoff;
+        }
+
+        write_section(fs,pos,meshlets.data(),meshlets.size()*sizeof(CacheMeshlet));
+
+        vector<glm::mat4> transforms;
+
+        for (const Instance& instance : prim->instances) {
+            transforms.push_back(instance.transform);
+        }
+
+        write_section(fs,pos,transforms.data(),transforms.size()*sizeof(glm::mat4));
+
+        // VBO contents, back to back in the order read_vbos expects
+        write_section(fs,pos,nullptr,0);
+
+        if (options.meshlets) {
+            for (const Meshlet& meshlet : prim->meshlets) {
+                write_bytes(fs,pos,meshlet.vbo->data,meshlet.count*sizeof(Vertex));
+            }
+        }
+        else {
+            write_bytes(fs,pos,prim->vbo->data,prim->index_count*sizeof(Vertex));
+        }
+
+        for (const Lod& lod : prim->lods) {
+            write_bytes(fs,pos,lod.vbo->data,lod.index_count*sizeof(Vertex));
+        }
+    }
+
+    fs.close();
+
+    if (fs.fail() or rename(tmp.c_str(),path.c_str())!=0) {
+        remove(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,32 @@
+#ifndef DEMO_CACHE_H
+#define DEMO_CACHE_H
+
+#include "mesh.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/*
+    Binary mesh cache. Stores the reordered unique vertices (packed ones
+    when only those are kept) and indices of every primitive, their
+    instances, meshlets and lod levels, and the contents of every triangle
+    VBO built from them, so a hit only copies those into new VBOs. Keyed by
+    a hash of the source file contents plus the path, size and modification
+    time of the side-car buffer files it uses.
+*/
+
+// hash of the whole file contents, 0 on error
+uint64_t hash_file(const char* filename);
+
+// hash_file of filename combined with the stat of side_files, 0 on error
+uint64_t hash_source(const char* filename,const std::vector<std::string>& side_files);
+
+// $BLASTER_CACHE_DIR, $XDG_CACHE_HOME/blaster-demo or ~/.cache/blaster-demo
+std::string mesh_cache_path(uint64_t hash);
+
+bool load_mesh_cache(const std::string& path,uint64_t hash,std::vector<Primitive*>& primitives,const BuildOptions& options);
+
+bool save_mesh_cache(const std::string& path,uint64_t hash,const std::vector<Primitive*>& primitives,const BuildOptions& options);
+
+#endif
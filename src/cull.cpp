@@ -0,0 +1,73 @@
+#include "cull.h"
+
+#include <cmath>
+
+Frustum frustum_from_matrix(const glm::mat4& mvp)
+{
+    Frustum frustum;
+
+    // glm matrices are column major, m[c][r]
+    glm::vec4 row[4];
+
+    for (int r=0;r<4;r++) {
+        row[r] = glm::vec4(mvp[0][r],mvp[1][r],mvp[2][r],mvp[3][r]);
+    }
+
+    // -w <= x,y,z <= w
+    frustum.planes[0] = row[3] + row[0];
+    frustum.planes[1] = row[3] - row[0];
+    frustum.planes[2] = row[3] + row[1];
+    frustum.planes[3] = row[3] - row[1];
+    frustum.planes[4] = row[3] + row[2];
+    frustum.planes[5] = row[3] - row[2];
+
+    for (int n=0;n<6;n++) {
+        glm::vec4& p = frustum.planes[n];
+        float len = sqrtf(p.x*p.x + p.y*p.y + p.z*p.z);
+
+        if (len>0.0f) {
+            p = p / len;
+        }
+    }
+
+    return frustum;
+}
+
+bool frustum_test_aabb(const Frustum& frustum,const glm::vec3& min,const glm::vec3& max)
+{
+    for (int n=0;n<6;n++) {
+        const glm::vec4& p = frustum.planes[n];
+
+        // box corner furthest along the plane normal
+        float x = (p.x>=0.0f) ? max.x : min.x;
+        float y = (p.y>=0.0f) ? max.y : min.y;
+        float z = (p.z>=0.0f) ? max.z : min.z;
+
+        if (p.x*x + p.y*y + p.z*z + p.w < 0.0f) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool frustum_test_sphere(const Frustum& frustum,const glm::vec3& center,float radius)
+{
+    for (int n=0;n<6;n++) {
+        const glm::vec4& p = frustum.planes[n];
+
+        if (p.x*center.x + p.y*center.y + p.z*center.z + p.w < -radius) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool meshlet_backfacing(const Meshlet& meshlet,const glm::vec3& camera)
+{
+    // conservative sphere/cone test from meshoptimizer
+    glm::vec3 view = meshlet.center - camera;
+
+    return glm::dot(view,meshlet.cone_axis) >= meshlet.cone_cutoff*glm::length(view) + meshlet.radius;
+}
@@ -0,0 +1,27 @@
+#ifndef DEMO_CULL_H
+#define DEMO_CULL_H
+
+#include "mesh.h"
+
+#include <glm/glm.hpp>
+
+/*
+    Clip planes extracted from a model-view-projection matrix, so they live
+    in the object space of whatever that matrix transforms
+*/
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+Frustum frustum_from_matrix(const glm::mat4& mvp);
+
+// false when the box is completely outside one of the planes
+bool frustum_test_aabb(const Frustum& frustum,const glm::vec3& min,const glm::vec3& max);
+
+bool frustum_test_sphere(const Frustum& frustum,const glm::vec3& center,float radius);
+
+// true when every triangle of the meshlet faces away from camera (object space)
+bool meshlet_backfacing(const Meshlet& meshlet,const glm::vec3& camera);
+
+#endif
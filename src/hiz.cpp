@@ -0,0 +1,188 @@
+#include "hiz.h"
+#include "pool.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+/*
+    Tile rows [row_start,row_end) of the first level. Pixels go through
+    bl_texture_get_depth, blaster does not document the layout of its
+    depth buffer, but are visited row by row.
+*/
+static void reduce_tiles(HiZ& hiz,bl_texture_t* depth,int row_start,int row_end)
+{
+    HiZLevel& level = hiz.levels[0];
+
+    for (int ty=row_start;ty<row_end;ty++) {
+        int y0 = ty*HIZ_TILE;
+        int y1 = min(y0+HIZ_TILE,hiz.height);
+
+        uint16_t* out = &level.depth[ty*level.width];
+        fill(out,out+level.width,0);
+
+        for (int y=y0;y<y1;y++) {
+            for (int tx=0;tx<level.width;tx++) {
+                int x0 = tx*HIZ_TILE;
+                int x1 = min(x0+HIZ_TILE,hiz.width);
+
+                uint16_t far = out[tx];
+
+                for (int x=x0;x<x1;x++) {
+                    far = max(far,bl_texture_get_depth(depth,x,y));
+                }
+
+                out[tx] = far;
+            }
+        }
+    }
+}
+
+static HiZLevel reduce_level(const HiZLevel& src)
+{
+    HiZLevel dst;
+
+    dst.width = max(1,(src.width+1)/2);
+    dst.height = max(1,(src.height+1)/2);
+    dst.depth.resize(dst.width*dst.height);
+
+    for (int y=0;y<dst.height;y++) {
+        int y0 = y*2;
+        int y1 = min(y0+1,src.height-1);
+
+        for (int x=0;x<dst.width;x++) {
+            int x0 = x*2;
+            int x1 = min(x0+1,src.width-1);
+
+            uint16_t a = max(src.depth[y0*src.width+x0],src.depth[y0*src.width+x1]);
+            uint16_t b = max(src.depth[y1*src.width+x0],src.depth[y1*src.width+x1]);
+
+            dst.depth[y*dst.width+x] = max(a,b);
+        }
+    }
+
+    return dst;
+}
+
+void build_hiz(HiZ& hiz,bl_raster_t* raster,int width,int height,const glm::mat4& clip)
+{
+    hiz.raster_width = raster->width;
+    hiz.raster_height = raster->height;
+    hiz.width = width;
+    hiz.height = height;
+    hiz.clip = clip;
+
+    hiz.levels.resize(1);
+
+    HiZLevel& base = hiz.levels[0];
+    base.width = (width+HIZ_TILE-1)/HIZ_TILE;
+    base.height = (height+HIZ_TILE-1)/HIZ_TILE;
+    base.depth.resize(base.width*base.height);
+
+    parallel_for(build_pool(),base.height,HIZ_PARALLEL_GRAIN,[&](size_t begin,size_t end) {
+        reduce_tiles(hiz,raster->depth_buffer,begin,end);
+    });
+
+    while (hiz.levels.back().width>1 or hiz.levels.back().height>1) {
+        hiz.levels.push_back(reduce_level(hiz.levels.back()));
+    }
+
+    hiz.valid = true;
+}
+
+size_t hiz_bytes(const HiZ& hiz)
+{
+    size_t bytes = 0;
+
+    for (const HiZLevel& level : hiz.levels) {
+        bytes+=level.depth.size()*sizeof(uint16_t);
+    }
+
+    return bytes;
+}
+
+uint16_t hiz_depth(float ndc_z)
+{
+    // blaster stores z from [-1,1] as unsigned 16 bit, far plane at 65535
+    float d = (ndc_z*0.5f + 0.5f) * 65535.0f;
+
+    return (uint16_t)min(65535.0f,max(0.0f,d));
+}
+
+bool hiz_occluded(const HiZ& hiz,const glm::mat4& transform,const glm::vec3& min,const glm::vec3& max)
+{
+    if (!hiz.valid) {
+        return false;
+    }
+
+    glm::mat4 clip = hiz.clip * transform;
+
+    float x0 = 1.0f, y0 = 1.0f, x1 = -1.0f, y1 = -1.0f;
+    float z0 = 1.0f;
+
+    for (int n=0;n<8;n++) {
+        glm::vec4 corner((n&1) ? max.x : min.x,(n&2) ? max.y : min.y,(n&4) ? max.z : min.z,1.0f);
+        glm::vec4 c = clip * corner;
+
+        if (c.w<=1e-6f) {
+            return false;
+        }
+
+        float x = c.x/c.w;
+        float y = c.y/c.w;
+        float z = c.z/c.w;
+
+        x0 = std::min(x0,x);
+        x1 = std::max(x1,x);
+        y0 = std::min(y0,y);
+        y1 = std::max(y1,y);
+        z0 = std::min(z0,z);
+    }
+
+    if (z0<-1.0f) {
+        return false;
+    }
+
+    // ndc to raster pixels, -1 being the top left corner
+    int px0 = (int)floorf((x0*0.5f+0.5f)*hiz.raster_width);
+    int px1 = (int)floorf((x1*0.5f+0.5f)*hiz.raster_width);
+    int py0 = (int)floorf((y0*0.5f+0.5f)*hiz.raster_height);
+    int py1 = (int)floorf((y1*0.5f+0.5f)*hiz.raster_height);
+
+    if (px1<0 or py1<0 or px0>=hiz.width or py0>=hiz.height) {
+        return false;
+    }
+
+    px0 = std::max(px0,0);
+    py0 = std::max(py0,0);
+    px1 = std::min(px1,hiz.width-1);
+    py1 = std::min(py1,hiz.height-1);
+
+    int tx0 = px0/HIZ_TILE;
+    int tx1 = px1/HIZ_TILE;
+    int ty0 = py0/HIZ_TILE;
+    int ty1 = py1/HIZ_TILE;
+
+    // finest level where the box covers at most 4x4 texels
+    size_t l = 0;
+
+    while ((tx1-tx0>3 or ty1-ty0>3) and l+1<hiz.levels.size()) {
+        tx0>>=1;
+        tx1>>=1;
+        ty0>>=1;
+        ty1>>=1;
+        l++;
+    }
+
+    const HiZLevel& level = hiz.levels[l];
+    uint16_t far = 0;
+
+    for (int y=ty0;y<=ty1;y++) {
+        for (int x=tx0;x<=tx1;x++) {
+            far = std::max(far,level.depth[y*level.width+x]);
+        }
+    }
+
+    return hiz_depth(z0)>far;
+}
@@ -0,0 +1,66 @@
+#ifndef DEMO_HIZ_H
+#define DEMO_HIZ_H
+
+#include <blaster/raster.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+// raster pixels per side of a texel of the first level
+#define HIZ_TILE 4
+
+// first level rows per range when reducing on the build pool
+#define HIZ_PARALLEL_GRAIN 8
+
+// farthest depth of a level, one texel per tile of the level below
+struct HiZLevel
+{
+    int width;
+    int height;
+
+    std::vector<uint16_t> depth;
+};
+
+/*
+    Max depth pyramid of a finished frame, with the clip matrix (viewport
+    included) it was rendered with. Occlusion tests project bounds through
+    that matrix, so they ask whether something was hidden last frame.
+*/
+struct HiZ
+{
+    bool valid = false;
+
+    // raster size, and the top left part of it the frame covered
+    int raster_width = 0;
+    int raster_height = 0;
+    int width = 0;
+    int height = 0;
+
+    glm::mat4 clip;
+
+    std::vector<HiZLevel> levels;
+};
+
+/*
+    Reduces the top left width x height depth pixels of raster, split in
+    bands of rows over build_pool. Call after bl_raster_flush_update and
+    before the next clear.
+*/
+void build_hiz(HiZ& hiz,bl_raster_t* raster,int width,int height,const glm::mat4& clip);
+
+// bytes of every level
+size_t hiz_bytes(const HiZ& hiz);
+
+// depth buffer value of a normalized device z
+uint16_t hiz_depth(float ndc_z);
+
+/*
+    True when the box, in the object space of transform, lies behind the
+    pyramid everywhere it covers. Boxes crossing the near plane or leaving
+    the covered area are never occluded.
+*/
+bool hiz_occluded(const HiZ& hiz,const glm::mat4& transform,const glm::vec3& min,const glm::vec3& max);
+
+#endif
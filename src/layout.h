@@ -0,0 +1,99 @@
+#ifndef DEMO_LAYOUT_H
+#define DEMO_LAYOUT_H
+
+#include <blaster/vector.h>
+#include <blaster/vbo.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+/*
+    Compile time description of a VBO vertex as a list of attributes,
+    each one a struct of floats (bl_vector_t, bl_color_t, bl_uv_t). The
+    component count handed to bl_vbo_new and the stride in bytes both
+    come from it, so the layout is written down exactly once.
+*/
+template <typename... Attributes>
+struct VertexLayout;
+
+template <>
+struct VertexLayout<>
+{
+    static constexpr size_t components = 0;
+    static constexpr size_t stride = 0;
+};
+
+template <typename First,typename... Rest>
+struct VertexLayout<First,Rest...>
+{
+    static_assert(sizeof(First)%sizeof(float)==0,"attributes are made of floats");
+
+    static constexpr size_t components = sizeof(First)/sizeof(float) + VertexLayout<Rest...>::components;
+    static constexpr size_t stride = components*sizeof(float);
+};
+
+// position, normal and uv of triangle VBOs
+typedef VertexLayout<bl_vector_t,bl_vector_t,bl_uv_t> TriangleLayout;
+
+// position and color of point and line VBOs
+typedef VertexLayout<bl_vector_t,bl_color_t> LineLayout;
+
+struct LineVertex
+{
+    bl_vector_t p;
+    bl_color_t c;
+};
+
+static_assert(sizeof(LineVertex)==LineLayout::stride,"LineVertex does not match LineLayout");
+
+// uninitialized VBO of count vertices with the components of Layout
+template <typename Layout>
+bl_vbo_t* new_vbo(size_t count)
+{
+    return bl_vbo_new(count,Layout::components);
+}
+
+/*
+    Vertex storage of the VBO, as V. Blaster keeps vertices packed, one
+    every components floats, so any V of the layout stride can be written
+    straight into it instead of through bl_vbo_set_v.
+*/
+template <typename Layout,typename V>
+V* vbo_vertices(bl_vbo_t* vbo)
+{
+    static_assert(sizeof(V)==Layout::stride,"vertex type does not match the layout");
+
+    return (V*)vbo->data;
+}
+
+// copies count vertices to first onwards
+template <typename Layout,typename V>
+void write_vbo(bl_vbo_t* vbo,size_t first,const V* vertices,size_t count)
+{
+    std::copy(vertices,vertices+count,vbo_vertices<Layout,V>(vbo)+first);
+}
+
+// de-indexes count vertices to first onwards
+template <typename Layout,typename V>
+void gather_vbo(bl_vbo_t* vbo,size_t first,const V* vertices,const uint32_t* indices,size_t count)
+{
+    V* out = vbo_vertices<Layout,V>(vbo) + first;
+
+    for (size_t n=0;n<count;n++) {
+        out[n] = vertices[indices[n]];
+    }
+}
+
+// writes make(n) as vertex n, for n in [first,first+count)
+template <typename Layout,typename V,typename Make>
+void fill_vbo(bl_vbo_t* vbo,size_t first,size_t count,Make make)
+{
+    V* out = vbo_vertices<Layout,V>(vbo);
+
+    for (size_t n=first;n<first+count;n++) {
+        out[n] = make(n);
+    }
+}
+
+#endif
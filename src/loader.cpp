@@ -0,0 +1,974 @@
+#include "loader.h"
+
+#include "memory.h"
+#include "cache.h"
+#include "obj.h"
+#include "pool.h"
+
+#include <blaster/vector.h>
+
+#include <glm/ext.hpp>
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <mutex>
+#include <cstdlib>
+
+using namespace std;
+
+const uint8_t* GltfAsset::buffer_data(int buffer,size_t& size) const
+{
+    if (buffer == mapped_buffer) {
+        size = mapped_size;
+        return mapped_data;
+    }
+
+    const tinygltf::Buffer& b = model.buffers[buffer];
+    size = b.data.size();
+
+    return b.data.data();
+}
+
+static const uint32_t GLB_MAGIC = 0x46546C67;
+static const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+static const uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+static int base64_value(char c)
+{
+    if (c>='A' and c<='Z') return c-'A';
+    if (c>='a' and c<='z') return c-'a'+26;
+    if (c>='0' and c<='9') return c-'0'+52;
+    if (c=='+') return 62;
+    if (c=='/') return 63;
+
+    return -1;
+}
+
+string base64_decode(const char* data,size_t size)
+{
+    string out;
+    out.reserve((size/4)*3);
+
+    uint32_t v = 0;
+    int bits = 0;
+
+    for (size_t n=0;n<size;n++) {
+        int d = base64_value(data[n]);
+
+        // padding ends the data, anything else unknown is skipped
+        if (data[n]=='=') {
+            break;
+        }
+
+        if (d<0) {
+            continue;
+        }
+
+        v = (v<<6) | d;
+        bits+=6;
+
+        if (bits>=8) {
+            bits-=8;
+            out.push_back((char)((v>>bits) & 0xff));
+        }
+    }
+
+    return out;
+}
+
+// %XX escapes of a relative uri
+static string uri_path(const string& uri)
+{
+    string path;
+
+    for (size_t n=0;n<uri.size();n++) {
+        if (uri[n]=='%' and n+2<uri.size()) {
+            path.push_back((char)strtol(uri.substr(n+1,2).c_str(),nullptr,16));
+            n+=2;
+        }
+        else {
+            path.push_back(uri[n]);
+        }
+    }
+
+    return path;
+}
+
+/*
+    Bytes a uri points at: data uris are decoded into decoded, files
+    relative to base_dir are mapped into file
+*/
+static bool uri_bytes(const string& uri,const string& base_dir,MappedFile& file,string& decoded,const uint8_t*& data,size_t& size)
+{
+    if (uri.compare(0,5,"data:")==0) {
+        size_t comma = uri.find(',');
+
+        if (comma==string::npos) {
+            return false;
+        }
+
+        decoded = base64_decode(uri.c_str()+comma+1,uri.size()-comma-1);
+        data = (const uint8_t*)decoded.data();
+        size = decoded.size();
+
+        return true;
+    }
+
+    if (!file.open((base_dir + "/" + uri_path(uri)).c_str())) {
+        return false;
+    }
+
+    data = file.data;
+    size = file.size;
+
+    return true;
+}
+
+/*
+    Decodes image n of a glTF json document through tinygltf's stb_image
+    loader, straight from the bytes it uses: a range of bin (the glb
+    binary chunk) or of a mapped buffer file, a data uri or an image file.
+    Nothing else of the buffers is read.
+*/
+static bool decode_image(nlohmann::json& doc,size_t n,const string& base_dir,const uint8_t* bin,size_t bin_size,tinygltf::Image& image)
+{
+    nlohmann::json& entry = doc["images"][n];
+
+    image.name = entry.value("name",string());
+    image.mimeType = entry.value("mimeType",string());
+
+    MappedFile file;
+    string decoded;
+    const uint8_t* bytes = nullptr;
+    size_t size = 0;
+
+    if (entry.find("bufferView")!=entry.end()) {
+        size_t index = entry["bufferView"].get<size_t>();
+
+        if (doc.find("bufferViews")==doc.end() or index>=doc["bufferViews"].size()) {
+            return false;
+        }
+
+        nlohmann::json& view = doc["bufferViews"][index];
+        size_t buffer = view.value("buffer",(size_t)0);
+        size_t offset = view.value("byteOffset",(size_t)0);
+        size = view.value("byteLength",(size_t)0);
+
+        if (doc.find("buffers")==doc.end() or buffer>=doc["buffers"].size()) {
+            return false;
+        }
+
+        nlohmann::json& b = doc["buffers"][buffer];
+        const uint8_t* data = bin;
+        size_t data_size = bin_size;
+
+        if (b.find("uri")!=b.end() and !uri_bytes(b["uri"].get<string>(),base_dir,file,decoded,data,data_size)) {
+            return false;
+        }
+
+        if (!data or offset>data_size or size>data_size-offset) {
+            return false;
+        }
+
+        bytes = data + offset;
+    }
+    else if (entry.find("uri")!=entry.end()) {
+        if (!uri_bytes(entry["uri"].get<string>(),base_dir,file,decoded,bytes,size)) {
+            return false;
+        }
+    }
+    else {
+        return false;
+    }
+
+    string err;
+    string warn;
+
+    return tinygltf::LoadImageData(&image,(int)n,&err,&warn,0,0,bytes,(int)size,nullptr);
+}
+
+// every image of doc, left empty when it can not be decoded
+static void decode_images(nlohmann::json& doc,const string& base_dir,const uint8_t* bin,size_t bin_size,vector<tinygltf::Image>& images)
+{
+    size_t count = (doc.find("images")!=doc.end()) ? doc["images"].size() : 0;
+
+    images.clear();
+    images.resize(count);
+
+    for (size_t n=0;n<count;n++) {
+        if (!decode_image(doc,n,base_dir,bin,bin_size,images[n])) {
+            clog<<"Failed to decode image "<<n<<endl;
+            images[n] = tinygltf::Image();
+        }
+    }
+}
+
+// directory relative uris of filename are resolved against
+static string base_directory(const char* filename)
+{
+    string dir = filename;
+    size_t sep = dir.find_last_of('/');
+
+    return (sep==string::npos) ? string(".") : dir.substr(0,sep);
+}
+
+/*
+    Json and binary chunks of a glb, bin is null when there is no binary
+    chunk
+*/
+static bool glb_chunks(const uint8_t* data,size_t size,const char*& json,size_t& json_size,const uint8_t*& bin,size_t& bin_size,string* err)
+{
+    const uint32_t* header = (const uint32_t*)data;
+
+    if (size<20 or header[0]!=GLB_MAGIC or header[1]!=2 or header[2]>size) {
+        *err = "Invalid glb header";
+        return false;
+    }
+
+    json_size = header[3];
+
+    if (header[4]!=GLB_CHUNK_JSON or 20+json_size>size) {
+        *err = "Invalid glb json chunk";
+        return false;
+    }
+
+    json = (const char*)(data + 20);
+    bin = nullptr;
+    bin_size = 0;
+
+    size_t bin_offset = 20 + json_size;
+
+    if (bin_offset+8<=size) {
+        const uint32_t* chunk = (const uint32_t*)(data + bin_offset);
+
+        if (chunk[1]==GLB_CHUNK_BIN and bin_offset+8+chunk[0]<=size) {
+            bin = data + bin_offset + 8;
+            bin_size = chunk[0];
+        }
+    }
+
+    return true;
+}
+
+/*
+    Parses the json chunk of a memory mapped .glb. The buffer living in the
+    binary chunk is replaced by an empty one so tinygltf does not copy it,
+    accessors reach it through GltfAsset::buffer_data instead. Images are
+    kept away from tinygltf and decoded by decode_images from the bytes
+    they use, so the ones in the binary chunk are never copied either.
+*/
+bool load_glb(GltfAsset& asset,const string& base_dir,string* err,string* warn)
+{
+    const char* json_data;
+    size_t json_size;
+
+    if (!glb_chunks(asset.file.data,asset.file.size,json_data,json_size,asset.mapped_data,asset.mapped_size,err)) {
+        return false;
+    }
+
+    nlohmann::json doc = nlohmann::json::parse(json_data,json_data+json_size,nullptr,false);
+
+    if (doc.is_discarded()) {
+        *err = "Invalid glb json";
+        return false;
+    }
+
+    // before the mapped buffer is emptied below
+    vector<tinygltf::Image> images;
+    decode_images(doc,base_dir,asset.mapped_data,asset.mapped_size,images);
+    doc.erase("images");
+
+    if (doc.find("buffers")!=doc.end()) {
+        nlohmann::json& buffers = doc["buffers"];
+
+        for (size_t n=0;n<buffers.size();n++) {
+            if (buffers[n].find("uri")==buffers[n].end()) {
+                asset.mapped_buffer = n;
+                buffers[n]["byteLength"] = 0;
+                buffers[n]["uri"] = "data:application/octet-stream;base64,";
+                break;
+            }
+        }
+    }
+
+    string json = doc.dump();
+
+    tinygltf::TinyGLTF loader;
+
+    if (!loader.LoadASCIIFromString(&asset.model,err,warn,json.c_str(),json.size(),base_dir)) {
+        return false;
+    }
+
+    asset.model.images.swap(images);
+
+    return true;
+}
+
+bool load_gltf(GltfAsset &asset, const char *filename) {
+    tinygltf::TinyGLTF loader;
+    std::string err;
+    std::string warn;
+
+    size_t rss_start = resident_memory();
+    auto t0 = std::chrono::steady_clock::now();
+
+    bool res;
+    bool glb = false;
+
+    if (asset.file.open(filename) and asset.file.size>=4 and *(const uint32_t*)asset.file.data==GLB_MAGIC) {
+        glb = true;
+        res = load_glb(asset,base_directory(filename),&err,&warn);
+    }
+    else {
+        asset.file.close();
+        res = loader.LoadASCIIFromFile(&asset.model, &err, &warn, filename);
+    }
+
+    if (!warn.empty()) {
+    std::clog << "WARN: " << warn << std::endl;
+    }
+
+    if (!err.empty()) {
+    std::clog << "ERR: " << err << std::endl;
+    }
+
+    if (!res)
+    std::clog << "Failed to load glTF: " << filename << std::endl;
+    else
+    std::clog << "Loaded glTF: " << filename << (glb ? " (mapped glb)" : "") << std::endl;
+
+    auto t1 = std::chrono::steady_clock::now();
+    size_t rss_end = resident_memory();
+
+    std::clog << "load time: " << std::chrono::duration_cast<std::chrono::milliseconds>(t1-t0).count() << " ms" << std::endl;
+    std::clog << "resident memory: " << rss_start/(1024*1024) << " MB -> " << rss_end/(1024*1024) << " MB" << std::endl;
+
+    return res;
+}
+
+bool load_gltf_images(GltfAsset& asset,const char* filename)
+{
+    auto t0 = std::chrono::steady_clock::now();
+
+    if (!asset.file.open(filename)) {
+        clog<<"Failed to open glTF: "<<filename<<endl;
+        return false;
+    }
+
+    string base_dir = base_directory(filename);
+
+    const char* json_data = (const char*)asset.file.data;
+    size_t json_size = asset.file.size;
+    const uint8_t* bin = nullptr;
+    size_t bin_size = 0;
+    string err;
+
+    if (asset.file.size>=4 and *(const uint32_t*)asset.file.data==GLB_MAGIC and
+        !glb_chunks(asset.file.data,asset.file.size,json_data,json_size,bin,bin_size,&err)) {
+        clog<<"ERR: "<<err<<endl;
+        asset.file.close();
+        return false;
+    }
+
+    nlohmann::json doc = nlohmann::json::parse(json_data,json_data+json_size,nullptr,false);
+
+    if (doc.is_discarded()) {
+        clog<<"Failed to parse glTF: "<<filename<<endl;
+        asset.file.close();
+        return false;
+    }
+
+    asset.model = tinygltf::Model();
+
+    if (doc.find("textures")!=doc.end()) {
+        nlohmann::json& textures = doc["textures"];
+
+        for (size_t n=0;n<textures.size();n++) {
+            tinygltf::Texture texture;
+            texture.source = textures[n].value("source",-1);
+            asset.model.textures.push_back(texture);
+        }
+    }
+
+    decode_images(doc,base_dir,bin,bin_size,asset.model.images);
+    asset.file.close();
+
+    auto t1 = std::chrono::steady_clock::now();
+    clog<<"Loaded glTF images: "<<filename<<", "<<asset.model.images.size()<<" in "<<std::chrono::duration_cast<std::chrono::milliseconds>(t1-t0).count()<<" ms"<<endl;
+
+    return true;
+}
+
+void release_geometry(GltfAsset& asset)
+{
+    size_t rss_start = resident_memory();
+
+    for (tinygltf::Buffer& buffer : asset.model.buffers) {
+        vector<unsigned char>().swap(buffer.data);
+    }
+
+    asset.mapped_buffer = -1;
+    asset.mapped_data = nullptr;
+    asset.mapped_size = 0;
+    asset.file.close();
+
+    size_t rss_end = resident_memory();
+
+    clog<<"released glTF buffers: "<<rss_start/(1024*1024)<<" MB -> "<<rss_end/(1024*1024)<<" MB resident"<<endl;
+}
+
+size_t component_size(int component_type)
+{
+    switch (component_type) {
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return 1;
+
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            return 2;
+
+        case TINYGLTF_COMPONENT_TYPE_INT:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:
+            return 4;
+    }
+
+    return 0;
+}
+
+size_t type_components(int type)
+{
+    switch (type) {
+        case TINYGLTF_TYPE_SCALAR:
+            return 1;
+        case TINYGLTF_TYPE_VEC2:
+            return 2;
+        case TINYGLTF_TYPE_VEC3:
+            return 3;
+        case TINYGLTF_TYPE_VEC4:
+            return 4;
+    }
+
+    return 0;
+}
+
+bool get_accessor_view(const GltfAsset& asset,int index,AccessorView& view)
+{
+    const tinygltf::Model& model = asset.model;
+
+    view.data = nullptr;
+    view.stride = 0;
+    view.count = 0;
+
+    if (index<0 or index>=(int)model.accessors.size()) {
+        return false;
+    }
+
+    const tinygltf::Accessor& accessor = model.accessors[index];
+
+    if (accessor.bufferView<0) {
+        clog<<"Unhandled sparse or empty accessor"<<endl;
+        return false;
+    }
+
+    const tinygltf::BufferView& bview = model.bufferViews[accessor.bufferView];
+
+    size_t buffer_size;
+    const uint8_t* buffer = asset.buffer_data(bview.buffer,buffer_size);
+
+    size_t element = component_size(accessor.componentType) * type_components(accessor.type);
+
+    if (element==0) {
+        clog<<"Unhandled accessor format"<<endl;
+        return false;
+    }
+
+    view.type = accessor.type;
+    view.component_type = accessor.componentType;
+    view.normalized = accessor.normalized;
+    view.count = accessor.count;
+    view.stride = (bview.byteStride>0) ? bview.byteStride : element;
+
+    size_t offset = bview.byteOffset + accessor.byteOffset;
+
+    if (view.count>0 and offset + view.stride*(view.count-1) + element > buffer_size) {
+        clog<<"Accessor out of buffer bounds"<<endl;
+        view.count = 0;
+        return false;
+    }
+
+    view.data = buffer + offset;
+
+    return true;
+}
+
+// local transform of a node, either its matrix or translation * rotation * scale
+static glm::mat4 node_transform(const tinygltf::Node& node)
+{
+    glm::mat4 transform(1.0f);
+
+    if (node.matrix.size()==16) {
+        for (int c=0;c<4;c++) {
+            for (int r=0;r<4;r++) {
+                transform[c][r] = node.matrix[c*4+r];
+            }
+        }
+
+        return transform;
+    }
+
+    if (node.translation.size()==3) {
+        transform = glm::translate(transform,glm::vec3(node.translation[0],node.translation[1],node.translation[2]));
+    }
+
+    if (node.rotation.size()==4) {
+        glm::quat q(node.rotation[3],node.rotation[0],node.rotation[1],node.rotation[2]);
+        transform = transform * glm::mat4_cast(q);
+    }
+
+    if (node.scale.size()==3) {
+        transform = glm::scale(transform,glm::vec3(node.scale[0],node.scale[1],node.scale[2]));
+    }
+
+    return transform;
+}
+
+static void traverse_node(const tinygltf::Model& model,int index,const glm::mat4& parent,
+                          vector<vector<Primitive*> >& meshes,size_t depth)
+{
+    // malformed files may have cycles
+    if (index<0 or index>=(int)model.nodes.size() or depth>model.nodes.size()) {
+        return;
+    }
+
+    const tinygltf::Node& node = model.nodes[index];
+    glm::mat4 world = parent * node_transform(node);
+
+    if (node.mesh>=0 and node.mesh<(int)meshes.size()) {
+        for (Primitive* prim : meshes[node.mesh]) {
+            Instance instance;
+            instance.transform = world;
+
+            prim->instances.push_back(instance);
+        }
+    }
+
+    for (int child : node.children) {
+        traverse_node(model,child,world,meshes,depth+1);
+    }
+}
+
+/*
+    Walks the default scene, or every root node when there are no scenes,
+    adding an instance to the primitives of each mesh for every node
+    referencing it
+*/
+static void build_instances(const tinygltf::Model& model,vector<vector<Primitive*> >& meshes)
+{
+    vector<int> roots;
+
+    if (!model.scenes.empty()) {
+        int scene = (model.defaultScene>=0 and model.defaultScene<(int)model.scenes.size()) ? model.defaultScene : 0;
+        roots = model.scenes[scene].nodes;
+    }
+    else {
+        vector<bool> child(model.nodes.size(),false);
+
+        for (const tinygltf::Node& node : model.nodes) {
+            for (int c : node.children) {
+                if (c>=0 and c<(int)child.size()) {
+                    child[c] = true;
+                }
+            }
+        }
+
+        for (size_t n=0;n<model.nodes.size();n++) {
+            if (!child[n]) {
+                roots.push_back(n);
+            }
+        }
+    }
+
+    for (int root : roots) {
+        traverse_node(model,root,glm::mat4(1.0f),meshes,0);
+    }
+}
+
+/*
+    Float attributes, plus the byte and short ones KHR_mesh_quantization
+    allows. Quantized positions rely on the node transforms to scale them
+    back, which build_instances already applies.
+*/
+static bool is_attribute_format(const AccessorView& view,int type)
+{
+    if (view.type != type) {
+        return false;
+    }
+
+    switch (view.component_type) {
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            return true;
+    }
+
+    return false;
+}
+
+vector<Primitive*> build_vbo(GltfAsset &asset,const BuildOptions& options,const PrimitiveReady& ready)
+{
+    tinygltf::Model& model = asset.model;
+    vector<Primitive*> primitives;
+
+    // primitives of every mesh, so nodes can reference them
+    vector<vector<Primitive*> > meshes(model.meshes.size());
+
+    for (const string& extension : model.extensionsUsed) {
+        if (extension == "KHR_mesh_quantization") {
+            clog<<"quantized attributes (KHR_mesh_quantization)"<<endl;
+        }
+    }
+
+    for (size_t m=0;m<model.meshes.size();m++) {
+        tinygltf::Mesh& mesh = model.meshes[m];
+        clog<<"Mesh:"<<endl;
+        for (tinygltf::Primitive& primitive : mesh.primitives) {
+
+            if (primitive.mode != TINYGLTF_MODE_TRIANGLES) {
+                clog<<"Unhandled mode:"<<primitive.mode<<endl;
+                continue;
+            }
+
+            AccessorView indices;
+
+            if (!get_accessor_view(asset,primitive.indices,indices) or
+                indices.type != TINYGLTF_TYPE_SCALAR or
+                !(indices.component_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT or
+                  indices.component_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT or
+                  indices.component_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE)) {
+                clog<<"Unhandled index format"<<endl;
+                continue;
+            }
+
+            clog<<"triangles: "<<indices.count/3<<endl;
+
+            AccessorView positions;
+            AccessorView normals;
+            AccessorView uvs;
+
+            for (auto& k : primitive.attributes) {
+
+                if (k.first == "POSITION") {
+                    if (!get_accessor_view(asset,k.second,positions) or
+                        !is_attribute_format(positions,TINYGLTF_TYPE_VEC3)) {
+                        clog<<"Unhandled format"<<endl;
+                        positions.count = 0;
+                        continue;
+                    }
+                    clog<<"vertices:"<<positions.count<<endl;
+                }
+
+                if (k.first == "NORMAL") {
+                    if (!get_accessor_view(asset,k.second,normals) or
+                        !is_attribute_format(normals,TINYGLTF_TYPE_VEC3)) {
+                        clog<<"Unhandled format"<<endl;
+                        normals.count = 0;
+                        continue;
+                    }
+                    clog<<"normals:"<<normals.count<<endl;
+                }
+
+                if (k.first == "TEXCOORD_0") {
+                    if (!get_accessor_view(asset,k.second,uvs) or
+                        !is_attribute_format(uvs,TINYGLTF_TYPE_VEC2)) {
+                        clog<<"Unhandled format"<<endl;
+                        uvs.count = 0;
+                        continue;
+                    }
+                    clog<<"uvs:"<<uvs.count<<endl;
+                }
+            }
+
+            if (positions.count == 0) {
+                clog<<"Missing positions"<<endl;
+                continue;
+            }
+
+            Primitive* prim = new Primitive();
+
+            if (primitive.material>=0 and primitive.material<(int)model.materials.size()) {
+                prim->material_texture = model.materials[primitive.material].pbrMetallicRoughness.baseColorTexture.index;
+            }
+
+            prim->vertices.resize(positions.count);
+
+            for (size_t i=0;i<positions.count;i++) {
+                Vertex& vertex = prim->vertices[i];
+
+                float p[3];
+                positions.read(i,p,3);
+                vertex.p.x = p[0];
+                vertex.p.y = p[1];
+                vertex.p.z = p[2];
+                vertex.p.w = 1;
+
+                vertex.n = {0,0,0,0};
+                vertex.t = {0,0};
+
+                if (i < normals.count) {
+                    float n[3];
+                    normals.read(i,n,3);
+                    vertex.n.x = n[0];
+                    vertex.n.y = n[1];
+                    vertex.n.z = n[2];
+                }
+
+                if (i < uvs.count) {
+                    float t[2];
+                    uvs.read(i,t,2);
+                    vertex.t.u = t[0];
+                    vertex.t.v = t[1];
+                }
+            }
+
+            size_t count = indices.count - (indices.count % 3);
+
+            if (count == 0) {
+                delete prim;
+                continue;
+            }
+
+            prim->indices.resize(count);
+
+            for (size_t i=0;i<count;i++) {
+                uint32_t index = indices.index(i);
+
+                if (index >= positions.count) {
+                    index = 0;
+                }
+
+                prim->indices[i] = index;
+            }
+
+            meshes[m].push_back(prim);
+        }
+    }
+
+    // meshes only get drawn through nodes, unless the file has none at all
+    if (!model.nodes.empty()) {
+        build_instances(model,meshes);
+    }
+
+    size_t instances = 0;
+    size_t unused = 0;
+
+    for (vector<Primitive*>& mesh : meshes) {
+        for (Primitive* prim : mesh) {
+            if (!model.nodes.empty() and prim->instances.empty()) {
+                delete prim;
+                unused++;
+                continue;
+            }
+
+            primitives.push_back(prim);
+        }
+    }
+
+    // one primitive per task, big ones split their vbos further
+    mutex ready_lock;
+
+    parallel_for(build_pool(),primitives.size(),1,[&](size_t begin,size_t end) {
+        for (size_t n=begin;n<end;n++) {
+            finish_primitive(primitives[n],options);
+
+            if (ready) {
+                lock_guard<mutex> guard(ready_lock);
+                ready(primitives[n]);
+            }
+        }
+    });
+
+    for (Primitive* prim : primitives) {
+        instances+=prim->instances.size();
+    }
+
+    clog<<"primitives: "<<primitives.size()<<", instances: "<<instances<<", unused: "<<unused<<endl;
+
+    return primitives;
+}
+
+vector<MipTexture*> build_textures(const GltfAsset& asset)
+{
+    const tinygltf::Model& model = asset.model;
+    vector<MipTexture*> textures;
+
+    size_t bytes = 0;
+
+    for (const tinygltf::Texture& gltf_texture : model.textures) {
+        MipTexture* texture = nullptr;
+
+        if (gltf_texture.source>=0 and gltf_texture.source<(int)model.images.size()) {
+            const tinygltf::Image& image = model.images[gltf_texture.source];
+
+            if (image.bits==8 and image.component>=1 and image.component<=4 and
+                image.image.size()>=(size_t)image.width*image.height*image.component) {
+                texture = new MipTexture();
+                build_mip_chain(*texture,image.image.data(),image.width,image.height,image.component);
+
+                for (MipLevel& level : texture->levels) {
+                    bytes+=level.pixels.size()*sizeof(uint32_t);
+                }
+            }
+            else {
+                clog<<"Unhandled image format: "<<image.name<<endl;
+            }
+        }
+
+        textures.push_back(texture);
+    }
+
+    clog<<"textures: "<<textures.size()<<", "<<bytes/(1024*1024)<<" MB with mip levels"<<endl;
+
+    return textures;
+}
+
+void bind_textures(vector<Primitive*>& primitives,const vector<MipTexture*>& textures)
+{
+    for (Primitive* prim : primitives) {
+        prim->texture = nullptr;
+
+        if (prim->material_texture>=0 and prim->material_texture<(int)textures.size()) {
+            prim->texture = textures[prim->material_texture];
+        }
+    }
+}
+
+// files referenced by the buffers of a glTF, empty for OBJ
+static vector<string> buffer_files(const char* filename)
+{
+    vector<string> files;
+    MappedFile file;
+
+    if (is_obj(filename) or !file.open(filename)) {
+        return files;
+    }
+
+    const char* json_data = (const char*)file.data;
+    size_t json_size = file.size;
+    const uint8_t* bin;
+    size_t bin_size;
+    string err;
+
+    if (file.size>=4 and *(const uint32_t*)file.data==GLB_MAGIC and
+        !glb_chunks(file.data,file.size,json_data,json_size,bin,bin_size,&err)) {
+        return files;
+    }
+
+    nlohmann::json doc = nlohmann::json::parse(json_data,json_data+json_size,nullptr,false);
+
+    if (doc.is_discarded() or doc.find("buffers")==doc.end()) {
+        return files;
+    }
+
+    nlohmann::json& buffers = doc["buffers"];
+
+    for (size_t n=0;n<buffers.size();n++) {
+        string uri = buffers[n].value("uri",string());
+
+        if (!uri.empty() and uri.compare(0,5,"data:")!=0) {
+            files.push_back(base_directory(filename) + "/" + uri_path(uri));
+        }
+    }
+
+    return files;
+}
+
+bool load_primitives(const char* filename,vector<Primitive*>& primitives,const BuildOptions& options,vector<MipTexture*>* textures,const PrimitiveReady& ready)
+{
+    auto t0 = std::chrono::steady_clock::now();
+
+    bool use_cache = getenv("BLASTER_NO_CACHE")==nullptr;
+    uint64_t hash = 0;
+    string path;
+
+    if (use_cache) {
+        hash = hash_source(filename,buffer_files(filename));
+        path = mesh_cache_path(hash);
+
+        if (hash!=0 and load_mesh_cache(path,hash,primitives,options)) {
+            auto t1 = std::chrono::steady_clock::now();
+            clog<<"Loaded mesh cache: "<<path<<" in "<<std::chrono::duration_cast<std::chrono::milliseconds>(t1-t0).count()<<" ms"<<endl;
+
+            if (ready) {
+                for (Primitive* prim : primitives) {
+                    ready(prim);
+                }
+            }
+
+            // images are not cached, they still come from the glTF
+            if (textures and !is_obj(filename)) {
+                GltfAsset asset;
+
+                if (load_gltf_images(asset,filename)) {
+                    *textures = build_textures(asset);
+
+                    if (!ready) {
+                        bind_textures(primitives,*textures);
+                    }
+                }
+            }
+
+            return true;
+        }
+    }
+
+    if (is_obj(filename)) {
+        if (!load_obj(filename,primitives,options)) {
+            return false;
+        }
+
+        if (ready) {
+            for (Primitive* prim : primitives) {
+                ready(prim);
+            }
+        }
+    }
+    else {
+        GltfAsset asset;
+
+        if (!load_gltf(asset,filename)) {
+            return false;
+        }
+
+        clog<<"meshes: "<<asset.model.meshes.size()<<endl;
+
+        primitives = build_vbo(asset,options,ready);
+        release_geometry(asset);
+
+        if (textures) {
+            *textures = build_textures(asset);
+
+            if (!ready) {
+                bind_textures(primitives,*textures);
+            }
+        }
+    }
+
+    if (use_cache and hash!=0) {
+        if (save_mesh_cache(path,hash,primitives,options)) {
+            clog<<"Saved mesh cache: "<<path<<endl;
+        }
+        else {
+            clog<<"Failed to save mesh cache: "<<path<<endl;
+        }
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+    clog<<"build time: "<<std::chrono::duration_cast<std::chrono::milliseconds>(t1-t0).count()<<" ms"<<endl;
+
+    return true;
+}
@@ -0,0 +1,153 @@
+#ifndef DEMO_LOADER_H
+#define DEMO_LOADER_H
+
+#include <blaster/vbo.h>
+
+#include <tiny_gltf.h>
+
+#include "mapped.h"
+#include "mesh.h"
+#include "texture.h"
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+/*
+    Strided window over an accessor's data inside its buffer, no copies
+    are made, so the view is only valid as long as the model is alive
+*/
+struct AccessorView
+{
+    const uint8_t* data = nullptr;
+    size_t stride = 0;
+    size_t count = 0;
+    int type = -1;
+    int component_type = -1;
+    bool normalized = false;
+
+    bool is(int t,int ct) const
+    {
+        return type == t and component_type == ct;
+    }
+
+    const float* floats(size_t n) const
+    {
+        return (const float*)(data + n*stride);
+    }
+
+    /*
+        Reads components of element n as floats, integer formats allowed
+        by KHR_mesh_quantization are converted, normalized ones to [0,1]
+        or [-1,1]
+    */
+    void read(size_t n,float* out,size_t components) const
+    {
+        const uint8_t* ptr = data + n*stride;
+
+        for (size_t c=0;c<components;c++) {
+            switch (component_type) {
+                case TINYGLTF_COMPONENT_TYPE_BYTE: {
+                    float v = ((const int8_t*)ptr)[c];
+                    out[c] = normalized ? std::max(v/127.0f,-1.0f) : v;
+                    break;
+                }
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+                    float v = ((const uint8_t*)ptr)[c];
+                    out[c] = normalized ? v/255.0f : v;
+                    break;
+                }
+                case TINYGLTF_COMPONENT_TYPE_SHORT: {
+                    float v = ((const int16_t*)ptr)[c];
+                    out[c] = normalized ? std::max(v/32767.0f,-1.0f) : v;
+                    break;
+                }
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+                    float v = ((const uint16_t*)ptr)[c];
+                    out[c] = normalized ? v/65535.0f : v;
+                    break;
+                }
+                default:
+                    out[c] = ((const float*)ptr)[c];
+            }
+        }
+    }
+
+    uint32_t index(size_t n) const
+    {
+        const uint8_t* ptr = data + n*stride;
+
+        switch (component_type) {
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                return *ptr;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+                return *(const uint16_t*)ptr;
+            default:
+                return *(const uint32_t*)ptr;
+        }
+    }
+};
+
+/*
+    Parsed glTF model plus, for .glb files, the mapping holding the binary
+    chunk. The chunk is never copied into model.buffers, use buffer_data
+    to reach the bytes of any buffer.
+*/
+struct GltfAsset
+{
+    tinygltf::Model model;
+
+    MappedFile file;
+    int mapped_buffer = -1;
+    const uint8_t* mapped_data = nullptr;
+    size_t mapped_size = 0;
+
+    const uint8_t* buffer_data(int buffer,size_t& size) const;
+};
+
+size_t component_size(int component_type);
+size_t type_components(int type);
+
+bool get_accessor_view(const GltfAsset& asset,int index,AccessorView& view);
+
+bool load_gltf(GltfAsset &asset, const char *filename);
+
+/*
+    Reads only what build_textures needs: texture sources and decoded
+    images. Meshes, accessors and the geometry in the buffers are never
+    parsed, used when the primitives come from the mesh cache.
+*/
+bool load_gltf_images(GltfAsset& asset,const char* filename);
+
+/*
+    Frees buffer contents and unmaps the file once primitives are built,
+    decoded images are kept for build_textures. Accessor views are invalid
+    afterwards.
+*/
+void release_geometry(GltfAsset& asset);
+
+// called with every primitive as soon as it is set up, from the building thread
+typedef std::function<void(Primitive*)> PrimitiveReady;
+
+std::vector<Primitive*> build_vbo(GltfAsset &asset,const BuildOptions& options,const PrimitiveReady& ready=PrimitiveReady());
+
+// one mip chain per glTF texture, null for images that could not be decoded
+std::vector<MipTexture*> build_textures(const GltfAsset& asset);
+
+// points every primitive at its material's base color texture
+void bind_textures(std::vector<Primitive*>& primitives,const std::vector<MipTexture*>& textures);
+
+/*
+    Loads primitives from the mesh cache when it matches the file, otherwise
+    builds them from the glTF (or OBJ, by extension) and refreshes the cache. Set BLASTER_NO_CACHE
+    to always go through tinygltf. When textures is given, it gets the
+    glTF textures, bound to the primitives but not uploaded. ready sees
+    glTF primitives one by one while they are built, cached and OBJ ones
+    once all of them are loaded. Primitives handed to ready may already be
+    in use by another thread, so textures are left for it to bind, nothing
+    else in them changes once handed over.
+*/
+bool load_primitives(const char* filename,std::vector<Primitive*>& primitives,const BuildOptions& options,std::vector<MipTexture*>* textures=nullptr,const PrimitiveReady& ready=PrimitiveReady());
+
+#endif
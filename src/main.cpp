@@ -10,6 +10,14 @@
 #include <tiny_gltf.h>
 #include <SDL2/SDL.h>
 
+#include "loader.h"
+#include "render.h"
+#include "profile.h"
+#include "tune.h"
+#include "resolution.h"
+#include "stream.h"
+#include "memory.h"
+
 #include <string>
 #include <iostream>
 #include <fstream>
@@ -17,404 +25,89 @@
 #include <chrono>
 #include <list>
 #include <memory>
+#include <cstdlib>
 
 using namespace std;
 
-#define WIDTH 1920
-#define HEIGHT 1080
 
-enum class RenderMode {
-    Points,
-    Lines,
-    Triangles
+enum class UploadMode {
+    Copy,
+    Locked
 };
 
-struct Triangle
+// frames rendered ahead of the one on screen are limited to one
+#define MAX_PIPELINE 2
+
+/*
+    Color buffer of a frame in flight and the texture it is shown through.
+    Zero copy upload: while the frame is rendered the color buffer of the
+    raster points at the pixels of the locked streaming texture, so update
+    workers resolve straight into texture memory and unlocking is all that
+    is left. Otherwise the frame renders into buffer, copied on present.
+*/
+struct FrameSlot
 {
-    int v[3];
-    int n[3];
-    int t[3];
-};
+    SDL_Texture* texture;
+    uint8_t* buffer;
 
-struct Mesh
-{
-    vector<bl_vector_t> vertices;
-    vector<bl_vector_t> normals;
-    vector<bl_uv_t> uvs;
-    
-    vector<Triangle> triangles;
-};
+    // raster and texture size, and the part this frame covers
+    int width;
+    int height;
+    SDL_Rect rect;
 
-std::ostream& operator<<(std::ostream& os,Triangle& t)
-{
-    os<<"("<<t.v[0]<<" "<<t.v[1]<<" "<<t.v[2]<<") ("<<t.n[0]<<" "<<t.n[1]<<" "<<t.n[2]<<")";
-    
-    return os;
-}
+    uint8_t* data;
+    UploadMode upload;
+
+    std::chrono::steady_clock::time_point start;
+};
 
-vector<string> split(string line,char sep=' ')
+// points the raster at the slot memory, false if the texture could not be locked
+bool begin_frame(bl_raster_t* raster,FrameSlot& slot,UploadMode mode)
 {
-    vector<string> tokens;
-    
-    bool knee=false;
-    string tmp;
+    slot.upload = UploadMode::Copy;
+    slot.data = slot.buffer;
+    slot.start = std::chrono::steady_clock::now();
 
-    for (char c : line) {
+    if (mode==UploadMode::Locked) {
+        void* pixels;
+        int pitch;
 
-        if (c==sep) {
-            tokens.push_back(tmp);
-            tmp="";
+        if (SDL_LockTexture(slot.texture,NULL,&pixels,&pitch)!=0) {
+            clog<<"Failed to lock texture: "<<SDL_GetError()<<endl;
+        }
+        else if (pitch!=slot.width*(int)sizeof(uint32_t)) {
+            clog<<"Texture pitch "<<pitch<<" does not match the color buffer"<<endl;
+            SDL_UnlockTexture(slot.texture);
         }
         else {
-            tmp=tmp+c;
+            slot.upload = UploadMode::Locked;
+            slot.data = (uint8_t*)pixels;
         }
     }
 
-    tokens.push_back(tmp);
-    
-    return tokens;
-}
+    raster->color_buffer->data = slot.data;
 
-Mesh* load_obj(char* filename)
-{
-    clog<<"loading: "<<filename<<endl;
-    
-    fstream fs;
-    
-    setlocale(LC_NUMERIC,"C");
-    
-    fs.open(filename,fstream::in);
-    
-    Mesh* mesh = new Mesh();
-    
-    while (!fs.eof()) {
-        string line;
-        getline(fs,line);
-        
-        vector<string> tmp = split(line);
-        
-        if (tmp.size()<=0) {
-            continue;
-        }
-        
-        if (tmp[0]=="v") {
-            bl_vector_t v;
-            
-            v.x=stof(tmp[1]);
-            v.y=stof(tmp[2]);
-            v.z=stof(tmp[3]);
-            v.w=1;
-            
-            mesh->vertices.push_back(v);
-        }
-        
-        if (tmp[0]=="vn") {
-            bl_vector_t n;
-            
-            n.x=stof(tmp[1]);
-            n.y=stof(tmp[2]);
-            n.z=stof(tmp[3]);
-            n.w=0;
-            
-            bl_vector_normalize(&n);
-            mesh->normals.push_back(n);
-        }
-        
-        if (tmp[0]=="vt") {
-            bl_uv_t uv;
-            
-            uv.u=stof(tmp[1]);
-            uv.v=stof(tmp[2]);
-            
-            mesh->uvs.push_back(uv);
-        }
-        
-        if (tmp[0]=="f") {
-            Triangle tri;
-            
-            vector<string> tmp2 = split(tmp[1],'/');
-            //clog<<">>"<<tmp2[0]<<","<<tmp2[1]<<endl;
-            tri.v[0]=stoi(tmp2[0])-1;
-            tri.t[0]=stoi(tmp2[1])-1;
-            tri.n[0]=stoi(tmp2[2])-1;
-            
-            tmp2 = split(tmp[2],'/');
-            tri.v[1]=stoi(tmp2[0])-1;
-            tri.t[1]=stoi(tmp2[1])-1;
-            tri.n[1]=stoi(tmp2[2])-1;
-            
-            tmp2 = split(tmp[3],'/');
-            tri.v[2]=stoi(tmp2[0])-1;
-            tri.t[2]=stoi(tmp2[1])-1;
-            tri.n[2]=stoi(tmp2[2])-1;
-            
-            mesh->triangles.push_back(tri);
-            /*
-            clog<<mesh->normals[tri.n[0]].x<<","<<mesh->normals[tri.n[0]].y<<","<<mesh->normals[tri.n[0]].z<<endl;
-            clog<<mesh->normals[tri.n[1]].x<<","<<mesh->normals[tri.n[1]].y<<","<<mesh->normals[tri.n[1]].z<<endl;
-            clog<<mesh->normals[tri.n[2]].x<<","<<mesh->normals[tri.n[2]].y<<","<<mesh->normals[tri.n[2]].z<<endl;
-            */
-        }
-    }
-    
-    fs.close();
-    
-    return mesh;
+    return slot.upload==mode;
 }
 
-
-
-bl_vbo_t* build_points_vbo(Mesh* mesh)
+/*
+    Makes the finished frame available to the texture. Unlocked pixels are
+    no longer ours, so a raster still pointing at them is given own back.
+*/
+void upload_frame(bl_raster_t* raster,FrameSlot& slot,uint8_t* own)
 {
-    bl_vbo_t* vbo;
-    
-    struct point_t {
-        bl_vector_t p;
-        bl_color_t c;
-    };
-    
-    vbo=bl_vbo_new(mesh->vertices.size(),8);
-    
-    for (size_t n=0;n<mesh->vertices.size();n++) {
-        struct point_t point = {0};
-        
-        point.p=mesh->vertices[n];
-        
-        bl_vbo_set_v(vbo,n,&point);
-    }
-    
-    return vbo;
-}
+    if (slot.upload==UploadMode::Locked) {
+        SDL_UnlockTexture(slot.texture);
 
-bl_vbo_t* build_lines_vbo(Mesh* mesh)
-{
-    bl_vbo_t* vbo;
-    
-    struct point_t {
-        bl_vector_t p;
-        bl_color_t c;
-    };
-    
-    vbo=bl_vbo_new(mesh->triangles.size()*6,8);
-    
-    int m=0;
-    for (size_t n=0;n<mesh->triangles.size();n++) {
-        point_t point = {0};
-        
-        point.p=mesh->vertices[mesh->triangles[n].v[0]];
-        bl_vbo_set_v(vbo,m,&point);
-        
-        point.p=mesh->vertices[mesh->triangles[n].v[1]];
-        bl_vbo_set_v(vbo,m+1,&point);
-        
-        point.p=mesh->vertices[mesh->triangles[n].v[1]];
-        bl_vbo_set_v(vbo,m+2,&point);
-        
-        point.p=mesh->vertices[mesh->triangles[n].v[2]];
-        bl_vbo_set_v(vbo,m+3,&point);
-        
-        point.p=mesh->vertices[mesh->triangles[n].v[2]];
-        bl_vbo_set_v(vbo,m+4,&point);
-        
-        point.p=mesh->vertices[mesh->triangles[n].v[0]];
-        bl_vbo_set_v(vbo,m+5,&point);
-        
-        m+=6;
-    }
-    
-    return vbo;
-}
-
-bl_vbo_t* build_triangles_vbo(Mesh* mesh)
-{
-    bl_vbo_t* vbo;
-    
-    struct point_t {
-        bl_vector_t p;
-        bl_vector_t n;
-        bl_uv_t t;
-    };
-    
-    vbo=bl_vbo_new(mesh->triangles.size()*3,10); //4,4,2
-    
-    int m=0;
-    for (size_t n=0;n<mesh->triangles.size();n++) {
-        point_t point = {0};
-        
-        point.p=mesh->vertices[mesh->triangles[n].v[0]];
-        point.n=mesh->normals[mesh->triangles[n].n[0]];
-        point.t=mesh->uvs[mesh->triangles[n].t[0]];
-        bl_vbo_set_v(vbo,m,&point);
-        
-        point.p=mesh->vertices[mesh->triangles[n].v[1]];
-        point.n=mesh->normals[mesh->triangles[n].n[1]];
-        point.t=mesh->uvs[mesh->triangles[n].t[1]];
-        bl_vbo_set_v(vbo,m+1,&point);
-
-        point.p=mesh->vertices[mesh->triangles[n].v[2]];
-        point.n=mesh->normals[mesh->triangles[n].n[2]];
-        point.t=mesh->uvs[mesh->triangles[n].t[2]];
-        bl_vbo_set_v(vbo,m+2,&point);
-        
-        m+=3;
-    }
-    
-    return vbo;
-}
-
-bool load_gltf(tinygltf::Model &model, const char *filename) {
-    tinygltf::TinyGLTF loader;
-    std::string err;
-    std::string warn;
-
-    bool res = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
-    if (!warn.empty()) {
-    std::clog << "WARN: " << warn << std::endl;
-    }
+        if (raster->color_buffer->data==slot.data) {
+            raster->color_buffer->data = own;
+        }
 
-    if (!err.empty()) {
-    std::clog << "ERR: " << err << std::endl;
+        slot.data = slot.buffer;
     }
-
-    if (!res)
-    std::clog << "Failed to load glTF: " << filename << std::endl;
-    else
-    std::clog << "Loaded glTF: " << filename << std::endl;
-
-    return res;
-}
-
-vector<bl_vbo_t*> build_vbo(tinygltf::Model &model)
-{
-    vector<bl_vbo_t*> vbos;
-
-    for (tinygltf::Mesh& mesh : model.meshes) {
-        clog<<"Mesh:"<<endl;
-        for (tinygltf::Primitive& primitive : mesh.primitives) {
-
-            if (primitive.mode == TINYGLTF_MODE_TRIANGLES) {
-                tinygltf::Accessor iaccessor = model.accessors[primitive.indices];
-
-                if (!(iaccessor.type == TINYGLTF_TYPE_SCALAR and iaccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)) {
-                    clog<<"Unhandled index format"<<endl;
-                    continue;
-                }
-
-                tinygltf::BufferView iview = model.bufferViews[iaccessor.bufferView];
-                tinygltf::Buffer ibuffer = model.buffers[iview.buffer];
-                uint8_t* ptr = (uint8_t*) ibuffer.data.data();
-                ptr = ptr + iview.byteOffset + iaccessor.byteOffset;
-                uint32_t* indices = (uint32_t*) ptr;
-
-                clog<<"triangles: "<<iaccessor.count/3<<endl;
-
-                vector<float> positions;
-                vector<float> normals;
-                vector<float> uvs;
-
-                for (auto k : primitive.attributes) {
-                    tinygltf::Accessor accessor = model.accessors[k.second];
-                    tinygltf::BufferView view = model.bufferViews[accessor.bufferView];
-                    tinygltf::Buffer buffer = model.buffers[view.buffer];
-
-                    if (k.first == "POSITION") {
-                        if (!(accessor.type == TINYGLTF_TYPE_VEC3 and accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT)) {
-                            clog<<"Unhandled format"<<endl;
-                            continue;
-                        }
-
-                        uint8_t* fptr = (uint8_t*) buffer.data.data();
-                        fptr = fptr + view.byteOffset + accessor.byteOffset;
-                        float* data = (float*) fptr;
-                        clog<<"vertices:"<<accessor.count<<endl;
-                        for (size_t n=0;n<accessor.count;n++) {
-                            positions.push_back(data[0]);
-                            positions.push_back(data[1]);
-                            positions.push_back(data[2]);
-                            data+=3;
-                        }
-                    }
-
-                    if (k.first == "NORMAL") {
-                        if (!(accessor.type == TINYGLTF_TYPE_VEC3 and accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT)) {
-                            clog<<"Unhandled format"<<endl;
-                            continue;
-                        }
-
-                        uint8_t* fptr = (uint8_t*) buffer.data.data();
-                        fptr = fptr + view.byteOffset + accessor.byteOffset;
-                        float* data = (float*) fptr;
-                        clog<<"normals:"<<accessor.count<<endl;
-                        for (size_t n=0;n<accessor.count;n++) {
-                            normals.push_back(data[0]);
-                            normals.push_back(data[1]);
-                            normals.push_back(data[2]);
-                            data+=3;
-                        }
-                    }
-
-                    if (k.first == "TEXCOORD_0") {
-                        if (!(accessor.type == TINYGLTF_TYPE_VEC2 and accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT)) {
-                            clog<<"Unhandled format"<<endl;
-                            continue;
-                        }
-
-                        uint8_t* fptr = (uint8_t*) buffer.data.data();
-                        fptr = fptr + view.byteOffset + accessor.byteOffset;
-                        float* data = (float*) fptr;
-                        clog<<"uvs:"<<accessor.count<<endl;
-                        for (size_t n=0;n<accessor.count;n++) {
-                            uvs.push_back(data[0]);
-                            uvs.push_back(data[1]);
-                            data+=2;
-                        }
-                    }
-
-                }
-
-                struct point_t {
-                    bl_vector_t p;
-                    bl_vector_t n;
-                    bl_uv_t t;
-                };
-
-                bl_vbo_t* vbo = bl_vbo_new(iaccessor.count,10); //4,4,2
-
-                for (size_t i=0;i<iaccessor.count;i+=3) {
-
-                    point_t point;
-
-                    for (size_t j=0;j<3;j++) {
-                        uint32_t index = indices[i+j];
-                        uint32_t vindex = index * 3;
-                        point.p.x = positions[vindex];
-                        point.p.y = positions[vindex+1];
-                        point.p.z = positions[vindex+2];
-                        point.p.w = 1;
-
-                        point.n.x = normals[vindex];
-                        point.n.y = normals[vindex+1];
-                        point.n.z = normals[vindex+2];
-                        point.n.w = 0;
-
-                        vindex = index * 2;
-                        point.t.u = uvs[vindex];
-                        point.t.v = uvs[vindex+1];
-
-                        bl_vbo_set_v(vbo,i+j,&point);
-                    }
-                }
-
-                vbos.push_back(vbo);
-
-            }
-            else {
-                clog<<"Unhandled mode:"<<primitive.mode<<endl;
-            }
-        }
+    else {
+        SDL_UpdateTexture(slot.texture,&slot.rect,(void*)slot.data,slot.width*sizeof(uint32_t));
     }
-
-    return vbos;
 }
 
 void print_time(string name,double value,int fps)
@@ -426,56 +119,158 @@ void print_time(string name,double value,int fps)
 
 int main(int argc,char* argv[])
 {
+    auto tstart = std::chrono::steady_clock::now();
+
     SDL_Window* window;
     SDL_Renderer* renderer;
-    SDL_Texture* texture;
     SDL_GLContext gl;
     
     bl_raster_t* raster;
-    vector<bl_vbo_t*> vbos;
+    vector<Primitive*> primitives;
     
     RenderMode mode = RenderMode::Triangles;
-    //RenderMode mode = RenderMode::Lines;
+    bool feature_edges = false;
+    
+    UploadMode upload_mode = UploadMode::Copy;
+    int pipeline = 1;
+    int width = 1920;
+    int height = 1080;
+    ResolutionController resolution;
+    const char* trace_file = nullptr;
+    bool tune = false;
+    WorkerConfig workers = default_worker_config(tune);
+    const char* workers_from = getenv("BLASTER_WORKERS") ? "BLASTER_WORKERS" : "default";
+    BuildOptions build_options;
+    build_options.release_vertices = true;
+    bool occlusion = false;
+    HiZ hiz;
+    vector<char*> files;
     
     clog<<"Blaster-demo"<<endl;
 
+    for (int n=1;n<argc;n++) {
+        string arg = argv[n];
+        
+        if (arg=="--meshlets") {
+            build_options.meshlets=true;
+        }
+        else if (arg=="--lod") {
+            build_options.lods=true;
+        }
+        else if (arg=="--quantize") {
+            build_options.quantize=true;
+        }
+        else if (arg=="--occlusion") {
+            occlusion=true;
+        }
+        else if (arg=="--zero-copy") {
+            upload_mode=UploadMode::Locked;
+        }
+        else if (arg=="--pipeline") {
+            pipeline=MAX_PIPELINE;
+        }
+        else if (arg=="--trace" and n+1<argc) {
+            trace_file=argv[++n];
+        }
+        else if (arg=="--size" and n+1<argc) {
+            if (sscanf(argv[++n],"%dx%d",&width,&height)!=2 or width<8 or height<8) {
+                cerr<<"Invalid --size "<<argv[n]<<", expected WxH"<<endl;
+                return -1;
+            }
+        }
+        else if (arg=="--target-ms" and n+1<argc) {
+            resolution.target_us = atof(argv[++n])*1000.0;
+        }
+        else if (arg=="--workers" and n+1<argc) {
+            string value = argv[++n];
+            tune = (value=="auto");
+            workers_from = "--workers";
+            
+            if (!tune and !parse_worker_config(value.c_str(),workers)) {
+                cerr<<"Invalid --workers "<<value<<", expected draw,update or auto"<<endl;
+                return -1;
+            }
+        }
+        else {
+            files.push_back(argv[n]);
+        }
+    }
 
-    if (argc<2) {
-        cerr<<"Missing GLTF file"<<endl;
+    if (files.size()<1) {
+        cerr<<"Missing GLTF or OBJ file"<<endl;
+        cerr<<"usage: blaster-demo [--meshlets] [--lod] [--quantize] [--occlusion] [--zero-copy] [--pipeline] [--trace file.json] [--workers D,U|auto] [--size WxH] [--target-ms MS] model [texture.tga]"<<endl;
         return -1;
     }
 
-    tinygltf::Model model;
+    /*
+        The model loads in the background while frames are already being
+        rendered, primitives show up as they are built. A tga given on the
+        command line replaces the glTF materials.
+    */
+    vector<MipTexture*> textures;
+    StreamLoader loader;
+    bool loaded = false;
 
-    if (!load_gltf(model,argv[1])) {
-        cerr<<"Failed to load gltf file"<<endl;
-        return -1;
-    }
+    start_stream(loader,files[0],build_options,files.size()<2);
 
-    clog<<"meshes: "<<model.meshes.size()<<endl;
+    // tuning needs the whole model
+    if (tune) {
+        wait_stream(loader,primitives);
+    }
 
-    vbos = build_vbo(model);
+    if (tune) {
+        float aspect=width/(float)height;
+        glm::mat4 mprojection = glm::frustum(-aspect,aspect,1.0f,-1.0f,1.0f,1000.0f);
+        glm::mat4 mmodel = glm::translate(glm::mat4(1.0f),glm::vec3(0.0f,0.0f,-30.0f));
 
+        workers = tune_workers(width,height,primitives,make_view(mprojection,mmodel,height));
+        workers_from = "auto";
+    }
 
+    clog<<"workers: "<<workers.draw_workers<<" draw, "<<workers.update_workers<<" update ("<<workers_from<<")"<<endl;
 
-    raster=bl_raster_new(WIDTH,HEIGHT,3,1);
+    raster=bl_raster_new(width,height,workers.draw_workers,workers.update_workers);
     
-    if (argc>2) {
-        bl_texture_t* tx = bl_tga_load(argv[2]);
-        bl_raster_set_texture(raster,tx);
-    }
+    // bound for every draw, glTF textures are ignored then
+    bl_texture_t* tga_texture = nullptr;
 
+    if (files.size()>1) {
+        tga_texture = bl_tga_load(files[1]);
+    }
 
     SDL_Init(SDL_INIT_EVERYTHING);
-    window = SDL_CreateWindow("blaster", 100, 100, WIDTH, HEIGHT, SDL_WINDOW_SHOWN);
+    window = SDL_CreateWindow("blaster", 100, 100, width, height, SDL_WINDOW_SHOWN);
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    texture = SDL_CreateTexture(renderer,SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, WIDTH,HEIGHT);
 
     bl_color_t clear_color;
     bl_color_set(&clear_color,0.9,0.9,0.9,1.0);
 
     bl_raster_set_clear_color(raster,&clear_color);
 
+    // owned by the raster, put back once the last frame is done
+    uint8_t* color_data = raster->color_buffer->data;
+
+    /*
+        With a pipeline the next frame is cleared and submitted to the draw
+        workers first, then the previous one is uploaded and presented while
+        workers rasterize, trading one frame of latency for throughput
+    */
+    FrameSlot slots[MAX_PIPELINE];
+
+    for (int n=0;n<pipeline;n++) {
+        slots[n].texture = SDL_CreateTexture(renderer,SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width,height);
+        slots[n].buffer = (n==0) ? color_data : new uint8_t[width*height*sizeof(uint32_t)];
+        slots[n].width = width;
+        slots[n].height = height;
+    }
+
+    FrameSlot* pending = nullptr;
+    int frame = 0;
+
+    if (pipeline>1) {
+        clog<<"pipelined frames: "<<pipeline<<" color buffers"<<endl;
+    }
+
     auto tfps = std::chrono::steady_clock::now();
     
     double dfps=0;
@@ -490,7 +285,23 @@ int main(int argc,char* argv[])
     double time_raster_update=0;
     double time_upload=0;
     double time_present=0;
+    double time_hiz=0;
     double time_total=0;
+    double time_latency=0;
+
+    // whole run upload time of each mode, to compare them
+    double upload_us[2]={0,0};
+    int upload_frames[2]={0,0};
+    
+    DrawStats draw_stats;
+
+    Profiler profiler;
+    profiler.trace = (trace_file!=nullptr);
+
+    FrameRecord record;
+
+    // worker times summed over the stats period
+    vector<WorkerTime> worker_totals(raster->draw_workers + raster->update_workers);
     
     float angle=0;
     float aspeed=0.01f;
@@ -499,16 +310,69 @@ int main(int argc,char* argv[])
     float Y=0;
     
     bool quit_request=false;
+    bool first_frame=true;
     
     bl_pixel_t pick;
     
     bool request_data=false;
     int rx,ry;
     
+    // raster buffers are 32 bit color and 16 bit depth
+    auto memory_report = [&]() -> MemoryReport {
+        MemoryReport report;
+
+        report.vbos = allocated_vbo_bytes(primitives);
+        report.meshes = mesh_bytes(primitives);
+        report.textures = texture_bytes(textures);
+        report.color_buffers = pipeline*(size_t)width*height*sizeof(uint32_t);
+        report.depth_buffer = (size_t)width*height*sizeof(uint16_t);
+        report.scratch = hiz_bytes(hiz);
+
+        return report;
+    };
+
+    /*
+        Shows a finished frame. Upload time per mode covers the lock
+        done when the frame began as well.
+    */
+    auto present = [&](FrameSlot& done) -> double {
+        auto p0 = std::chrono::steady_clock::now();
+
+        upload_frame(raster,done,color_data);
+
+        auto p1 = std::chrono::steady_clock::now();
+
+        // stretched to the window when rendered at a lower resolution
+        SDL_RenderCopy(renderer, done.texture, &done.rect, NULL);
+        SDL_RenderPresent(renderer);
+
+        auto p2 = std::chrono::steady_clock::now();
+
+        double us = std::chrono::duration_cast<std::chrono::microseconds>(p1-p0).count();
+        time_upload+=us;
+        upload_us[(int)done.upload]+=us;
+        upload_frames[(int)done.upload]++;
+
+        record_phase(record,PHASE_UPLOAD,profiler_time(profiler,p0),profiler_time(profiler,p1));
+        record_phase(record,PHASE_PRESENT,profiler_time(profiler,p1),profiler_time(profiler,p2));
+
+        time_present+=std::chrono::duration_cast<std::chrono::microseconds>(p2-p1).count();
+        time_latency+=std::chrono::duration_cast<std::chrono::microseconds>(p2-done.start).count();
+
+        if (first_frame) {
+            first_frame=false;
+            clog<<"time to first frame: "<<std::chrono::duration_cast<std::chrono::milliseconds>(p2-tstart).count()<<" ms, "<<primitives.size()<<" primitives loaded"<<endl;
+        }
+
+        return std::chrono::duration_cast<std::chrono::microseconds>(p2-p0).count();
+    };
+
     while(!quit_request) {
         SDL_Event event;
         
         auto t0a = std::chrono::steady_clock::now();
+        record = FrameRecord();
+        record.start = profiler_time(profiler,t0a);
         // eat events
         while(SDL_PollEvent(&event)) {
 
@@ -543,26 +407,89 @@ int main(int argc,char* argv[])
                     if (event.key.keysym.sym==SDLK_DOWN) {
                         Y+=1;
                     }
+                    if (event.key.keysym.sym==SDLK_m) {
+                        mode = (mode==RenderMode::Triangles) ? RenderMode::Lines : (mode==RenderMode::Lines) ? RenderMode::Points : RenderMode::Triangles;
+                        clog<<"render mode: "<<(mode==RenderMode::Triangles ? "triangles" : mode==RenderMode::Lines ? "lines" : "points")<<endl;
+                    }
+                    if (event.key.keysym.sym==SDLK_f) {
+                        feature_edges = !feature_edges;
+                        clog<<"feature edges only: "<<(feature_edges ? "on" : "off")<<endl;
+                    }
+                    if (event.key.keysym.sym==SDLK_z) {
+                        upload_mode = (upload_mode==UploadMode::Copy) ? UploadMode::Locked : UploadMode::Copy;
+                        clog<<"zero copy: "<<(upload_mode==UploadMode::Locked ? "on" : "off")<<endl;
+                    }
                 break;
             
             } // switch
         } // while
         
+        // primitives built since last frame join the scene
+        if (!loaded) {
+            poll_stream(loader,primitives);
+
+            if (stream_finished(loader,primitives)) {
+                loaded=true;
+
+                if (!loader.ok) {
+                    cerr<<"Failed to load model file"<<endl;
+                    quit_request=true;
+                }
+
+                textures = loader.textures;
+
+                for (MipTexture* texture : textures) {
+                    if (texture) {
+                        upload_texture(*texture,raster->color_buffer->type);
+                    }
+                }
+
+                bind_textures(primitives,textures);
+
+                clog<<"vbo bytes: "<<vbo_bytes(primitives,sizeof(Vertex))/(1024*1024)<<" MB"<<endl;
+                clog<<"vertex bytes: "<<vertex_bytes(primitives,sizeof(Vertex))/(1024*1024)<<" MB as float, "
+                    <<vertex_bytes(primitives,sizeof(QuantizedVertex))/(1024*1024)<<" MB quantized"
+                    <<(build_options.quantize or build_options.release_vertices ? ", quantized copy resident" : ", float copy resident")<<endl;
+                clog<<"time to fully loaded: "<<std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-tstart).count()<<" ms"<<endl;
+
+                print_memory_report(memory_report());
+            }
+        }
+
         auto t0b = std::chrono::steady_clock::now();
         time_input+=std::chrono::duration_cast<std::chrono::microseconds>(t0b-t0a).count();
+        record_phase(record,PHASE_INPUT,record.start,profiler_time(profiler,t0b));
         
         //render here
         auto t1 = std::chrono::steady_clock::now();
-        
+
+        FrameSlot& slot = slots[frame%pipeline];
+        frame++;
+
+        slot.rect.x = 0;
+        slot.rect.y = 0;
+        slot.rect.w = scaled_size(width,resolution.scale);
+        slot.rect.h = scaled_size(height,resolution.scale);
+
+        if (!begin_frame(raster,slot,upload_mode)) {
+            clog<<"Falling back to texture copy"<<endl;
+            upload_mode=UploadMode::Copy;
+        }
+
+        auto t1b = std::chrono::steady_clock::now();
+        double lock_us = std::chrono::duration_cast<std::chrono::microseconds>(t1b-t1).count();
+        time_upload+=lock_us;
+        upload_us[(int)slot.upload]+=lock_us;
+
         raster->start=bl_time_us();
+        record.raster_start=profiler_now(profiler);
         bl_raster_clear(raster);
 
         auto t2 = std::chrono::steady_clock::now();
-        time_clear+=std::chrono::duration_cast<std::chrono::microseconds>(t2-t1).count();
-        
-        auto t2a = std::chrono::steady_clock::now();
+        time_clear+=std::chrono::duration_cast<std::chrono::microseconds>(t2-t1b).count();
+        record_phase(record,PHASE_CLEAR,profiler_time(profiler,t1b),profiler_time(profiler,t2));
         
-        float aspect=WIDTH/(float)HEIGHT;
+        float aspect=width/(float)height;
         
         /*
         bl_matrix_stack_load_identity(raster->projection);
@@ -588,11 +515,17 @@ int main(int argc,char* argv[])
         mmodel = glm::translate(mmodel,glm::vec3(0.0f,Y,Z));
         mmodel = glm::rotate(mmodel,angle,glm::vec3(0.0f,1.0f,0.0f));
 
-        glm::mat4 mvp = mprojection * mmodel;
+        // matrix uniforms are set per instance by draw_primitives
+        View view = make_view(mprojection,mmodel,height);
+        set_viewport(view,slot.rect.w,slot.rect.h,width,height);
+
+        if (occlusion) {
+            view.hiz = &hiz;
+        }
 
-        bl_raster_uniform_set_matrix(raster,0 , (bl_matrix_t*)&mvp[0][0]);
-        bl_raster_uniform_set_matrix(raster,1 , (bl_matrix_t*)&mmodel[0][0]);
-        //bl_raster_uniform_set_matrix(raster,1 , raster->modelview->matrix);
+        view.texture = tga_texture;
+        view.mode = mode;
+        view.feature_edges = feature_edges;
 
         bl_vector_t light_pos = {0.0f,1.0f,4.0f,0.0f};
         bl_vector_normalize(&light_pos);
@@ -600,8 +533,14 @@ int main(int argc,char* argv[])
         
         auto t2b = std::chrono::steady_clock::now();
 
-        for (bl_vbo_t* vbo:vbos) {
-            bl_raster_draw(raster,vbo,BL_VBO_TRIANGLES);
+        draw_primitives(raster,primitives,view,draw_stats);
+
+        // previous frame goes out while draw workers are busy with this one
+        double overlapped = 0;
+
+        if (pending) {
+            overlapped = present(*pending);
+            pending = nullptr;
         }
 
         raster->main=bl_time_us();
@@ -614,35 +553,54 @@ int main(int argc,char* argv[])
 
         if (request_data) {
             request_data=false;
-            uint16_t depth = bl_texture_get_depth(raster->depth_buffer,rx,ry);
+            // window to raster pixels, for scaled frames
+            int px = rx*slot.rect.w/width;
+            int py = ry*slot.rect.h/height;
+            uint16_t depth = bl_texture_get_depth(raster->depth_buffer,px,py);
             cout<<"Depth at: "<<rx<<","<<ry<<": "<<depth<<endl;
         }
         
         auto t2c = std::chrono::steady_clock::now();
+
+        // depth is final here and stays until the next clear, update workers are idle
+        if (occlusion) {
+            build_hiz(hiz,raster,slot.rect.w,slot.rect.h,view.viewport*view.mvp);
+            time_hiz+=std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-t2c).count();
+        }
         
-        time_raster_draw+=std::chrono::duration_cast<std::chrono::microseconds>(t2b2-t2b).count();
-        time_raster_update+=std::chrono::duration_cast<std::chrono::microseconds>(t2c-t2b2).count();
-        
-        SDL_Rect rect;
+        double raster_draw = std::chrono::duration_cast<std::chrono::microseconds>(t2b2-t2b).count()-overlapped;
+        double raster_update = std::chrono::duration_cast<std::chrono::microseconds>(t2c-t2b2).count();
+        time_raster_draw+=raster_draw;
+        time_raster_update+=raster_update;
 
-        rect.x=0;
-        rect.y=0;
-        rect.w=WIDTH;
-        rect.h=HEIGHT;
+        if (update_resolution(resolution,raster_draw+raster_update)) {
+            clog<<"resolution: "<<scaled_size(width,resolution.scale)<<"x"<<scaled_size(height,resolution.scale)<<endl;
+        }
+        record_phase(record,PHASE_DRAW,profiler_time(profiler,t2b),profiler_time(profiler,t2b2));
+        record_phase(record,PHASE_UPDATE,profiler_time(profiler,t2b2),profiler_time(profiler,t2c));
 
-        auto t3 = std::chrono::steady_clock::now();
-        
-        SDL_UpdateTexture(texture,&rect,(void*)raster->color_buffer->data,WIDTH*sizeof(uint32_t));
-        
-        auto t4 = std::chrono::steady_clock::now();
-        time_upload+=std::chrono::duration_cast<std::chrono::microseconds>(t4-t3).count();
-        
-        SDL_RenderCopy(renderer, texture, NULL, NULL);
-        SDL_RenderPresent(renderer);
+        record_workers(record,raster);
+
+        for (size_t n=0;n<record.workers.size();n++) {
+            worker_totals[n].type=record.workers[n].type;
+            worker_totals[n].wait+=record.workers[n].wait;
+            worker_totals[n].work+=record.workers[n].work;
+            worker_totals[n].start=record.workers[n].start;
+            worker_totals[n].last=record.workers[n].last;
+        }
+
+        if (pipeline>1) {
+            pending = &slot;
+        }
+        else {
+            present(slot);
+        }
 
         auto t5 = std::chrono::steady_clock::now();
-        time_present+=std::chrono::duration_cast<std::chrono::microseconds>(t5-t4).count();
         time_total+=std::chrono::duration_cast<std::chrono::microseconds>(t5-t0a).count();
+
+        record.end = profiler_time(profiler,t5);
+        profiler_push(profiler,record);
         
         fps++;
         dfps=std::chrono::duration_cast<std::chrono::milliseconds>(t5-tfps).count();
@@ -678,24 +636,78 @@ int main(int argc,char* argv[])
             clog<<"fps min: "<<min_fps<<endl;
             clog<<"fps max: "<<max_fps<<endl;
             clog<<"fps avg: "<<avg<<endl;
+
+            Percentiles frame_time = profiler_percentiles(profiler);
+            clog<<"frame time: p50 "<<frame_time.p50/1000.0<<" ms, p95 "<<frame_time.p95/1000.0<<" ms, p99 "<<frame_time.p99/1000.0<<" ms, max "<<frame_time.max/1000.0<<" ms (last "<<frame_time.count<<" frames)"<<endl;
+            clog<<"resolution: "<<slot.rect.w<<"x"<<slot.rect.h<<" of "<<width<<"x"<<height;
+            if (resolution.target_us>0) {
+                clog<<", target "<<resolution.target_us/1000.0<<" ms draw+update";
+            }
+            clog<<endl;
             print_time("input",time_input,fps);
             print_time("clear",time_clear,fps);
             print_time("draw",time_raster_draw,fps);
             print_time("update",time_raster_update,fps);
-            print_time("upload",time_upload,fps);
+            print_time(upload_mode==UploadMode::Locked ? "upload (zero copy)" : "upload",time_upload,fps);
             print_time("present",time_present,fps);
+            if (occlusion) {
+                print_time("hi-z",time_hiz,fps);
+            }
+            
+            if (upload_frames[0]>0 and upload_frames[1]>0) {
+                double copy = upload_us[0]/upload_frames[0]/1000.0;
+                double locked = upload_us[1]/upload_frames[1]/1000.0;
+                clog<<"upload per frame: copy "<<copy<<" ms, zero copy "<<locked<<" ms, saved "<<copy-locked<<" ms"<<endl;
+            }
+            
+            clog<<"latency: "<<time_latency/fps/1000.0<<" ms from frame start to present";
+            if (pipeline>1) {
+                clog<<", "<<pipeline-1<<" frame behind";
+            }
+            clog<<endl;
             
-            clog<<"other: "<<(1000000-time_input-time_clear-time_raster_draw-time_raster_update-time_upload-time_present)/1000.0<<" ms"<<endl;
+            clog<<"other: "<<(1000000-time_input-time_clear-time_raster_draw-time_raster_update-time_upload-time_present-time_hiz)/1000.0<<" ms"<<endl;
             clog<<"total: "<<time_total/1000.0<<" ms"<<endl;
+            
+            clog<<"primitives: "<<draw_stats.primitives_drawn/fps<<" drawn, "<<draw_stats.primitives_culled/fps<<" culled"<<endl;
+            clog<<"instances: "<<draw_stats.instances_drawn/fps<<" drawn, "<<draw_stats.instances_culled/fps<<" culled, "<<draw_stats.draw_calls/fps<<" draw calls, "<<draw_stats.state_flushes/fps<<" state flushes"<<endl;
+            clog<<"triangles: "<<draw_stats.triangles_drawn/fps<<" drawn, "<<draw_stats.triangles_culled/fps<<" culled"<<endl;
+            if (mode!=RenderMode::Triangles) {
+                clog<<"wireframe: "<<draw_stats.lines_drawn/fps<<" lines, "<<draw_stats.points_drawn/fps<<" points"<<endl;
+            }
+            
+            if (build_options.meshlets) {
+                clog<<"meshlets: "<<draw_stats.meshlets_drawn/fps<<" drawn, "<<draw_stats.meshlets_culled/fps<<" outside, "<<draw_stats.meshlets_backfacing/fps<<" backfacing"<<endl;
+            }
+            if (occlusion) {
+                clog<<"occluded: "<<draw_stats.instances_occluded/fps<<" instances, "<<draw_stats.meshlets_occluded/fps<<" meshlets"<<endl;
+            }
+            if (build_options.lods) {
+                clog<<"lod instances:";
+                for (int n=0;n<=LOD_MAX_LEVELS;n++) {
+                    clog<<" "<<draw_stats.lod_primitives[n]/fps;
+                }
+                clog<<endl;
+                clog<<"lod triangles: "<<draw_stats.triangles_drawn/fps<<" drawn, "<<draw_stats.triangles_simplified/fps<<" simplified away"<<endl;
+            }
+            if (!textures.empty()) {
+                clog<<"mip instances:";
+                for (int n=0;n<MIP_MAX_LEVELS;n++) {
+                    clog<<" "<<draw_stats.mip_instances[n]/fps;
+                }
+                clog<<endl;
+            }
+            clog<<"vertex invocations: "<<draw_stats.vertices_shaded/fps<<" per frame, "<<draw_stats.vertex_cache_misses/fps<<" simulated misses with "<<VERTEX_CACHE_SIZE<<" entry cache"<<endl;
+            clog<<"simulated vertex cache hit ratio: "<<100.0*(1.0-draw_stats.vertex_cache_misses/(double)draw_stats.vertices_shaded)<<"%"<<endl;
+            print_memory_report(memory_report());
 
             clog<<endl<<"workers:"<<endl;
-            int num_workers = raster->draw_workers + raster->update_workers;
-            for (int n=0;n<num_workers;n++) {
-                int worker_type = raster->workers[n]->type;
-                clog<<"["<<(int)worker_type<<"] wait "<<raster->workers[n]->time.wait<<" us, work "<<raster->workers[n]->time.work<<" us"<<" job started at "<<raster->workers[n]->time.start-raster->start<<" and ended at "<<raster->workers[n]->time.last-raster->start<<" us"<<endl;
-                raster->workers[n]->time.wait=0;
-                raster->workers[n]->time.work=0;
-                if (worker_type == 1) {
+            for (size_t n=0;n<worker_totals.size();n++) {
+                WorkerTime& wt = worker_totals[n];
+                clog<<"["<<wt.type<<"] wait "<<wt.wait<<" us, work "<<wt.work<<" us"<<" job started at "<<wt.start<<" and ended at "<<wt.last<<" us"<<endl;
+                wt.wait=0;
+                wt.work=0;
+                if (wt.type == 1) {
                     clog<<"Chunks updated: "<<raster->workers[n]->update.chunks<<endl;
                 }
             }
@@ -710,7 +722,10 @@ int main(int argc,char* argv[])
             time_clear=0;
             time_upload=0;
             time_present=0;
+            time_hiz=0;
             time_total=0;
+            time_latency=0;
+            draw_stats=DrawStats();
             
             tfps = std::chrono::steady_clock::now();
         }
@@ -719,7 +734,43 @@ int main(int argc,char* argv[])
     
     
 
+    if (pending) {
+        present(*pending);
+    }
+
+    // the loading thread can not be interrupted
+    if (!loaded) {
+        clog<<"waiting for the model to finish loading"<<endl;
+        wait_stream(loader,primitives);
+        textures = loader.textures;
+    }
+    
+    raster->color_buffer->data = color_data;
+    
+    if (trace_file) {
+        if (write_trace(trace_file,profiler.history)) {
+            clog<<"Trace written to "<<trace_file<<endl;
+        }
+        else {
+            cerr<<"Failed to write trace "<<trace_file<<endl;
+        }
+    }
+    
+    for (int n=0;n<pipeline;n++) {
+        if (slots[n].buffer!=color_data) {
+            delete [] slots[n].buffer;
+        }
+        
+        SDL_DestroyTexture(slots[n].texture);
+    }
+
     bl_raster_delete(raster);
+
+    for (MipTexture* texture : textures) {
+        if (texture) {
+            delete_texture(texture);
+        }
+    }
     
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -0,0 +1,53 @@
+#include "mapped.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const char* filename)
+{
+    close();
+
+    int fd = ::open(filename,O_RDONLY);
+
+    if (fd<0) {
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(fd,&st)<0 or st.st_size==0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* ptr = mmap(nullptr,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+
+    // mapping keeps its own reference to the file
+    ::close(fd);
+
+    if (ptr==MAP_FAILED) {
+        return false;
+    }
+
+    data = (const uint8_t*)ptr;
+    size = st.st_size;
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data) {
+        munmap((void*)data,size);
+    }
+
+    data = nullptr;
+    size = 0;
+}
@@ -0,0 +1,26 @@
+#ifndef DEMO_MAPPED_H
+#define DEMO_MAPPED_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+    Read-only memory mapping of a whole file, pages are only read from disk
+    when touched
+*/
+struct MappedFile
+{
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    MappedFile() {}
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const char* filename);
+    void close();
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include "memory.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <cstdio>
+
+using namespace std;
+
+size_t resident_memory()
+{
+    FILE* fp = fopen("/proc/self/statm","r");
+
+    if (!fp) {
+        return 0;
+    }
+
+    long pages = 0;
+    long resident = 0;
+
+    if (fscanf(fp,"%ld %ld",&pages,&resident)!=2) {
+        resident = 0;
+    }
+
+    fclose(fp);
+
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+size_t peak_resident_memory()
+{
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF,&usage)<0) {
+        return 0;
+    }
+
+    // linux reports kilobytes
+    return usage.ru_maxrss * 1024;
+}
+
+static size_t mb(size_t bytes)
+{
+    return bytes/(1024*1024);
+}
+
+void print_memory_report(const MemoryReport& report)
+{
+    size_t total = report.vbos + report.meshes + report.textures + report.color_buffers + report.depth_buffer + report.scratch;
+
+    clog<<"memory: vbos "<<mb(report.vbos)<<" MB, meshes "<<mb(report.meshes)<<" MB, textures "<<mb(report.textures)<<" MB"<<endl;
+    clog<<"memory: color "<<mb(report.color_buffers)<<" MB, depth "<<mb(report.depth_buffer)<<" MB, scratch "<<mb(report.scratch)<<" MB"<<endl;
+    clog<<"memory: "<<mb(total)<<" MB accounted, "<<mb(resident_memory())<<" MB resident, "<<mb(peak_resident_memory())<<" MB peak"<<endl;
+}
@@ -0,0 +1,31 @@
+#ifndef DEMO_MEMORY_H
+#define DEMO_MEMORY_H
+
+#include <cstddef>
+
+// current resident set size, in bytes
+size_t resident_memory();
+
+// peak resident set size, in bytes
+size_t peak_resident_memory();
+
+/*
+    Bytes held by each part of the demo, filled in by the owner of each
+    part. Scratch is what the demo allocates per frame on top of the raster
+    (pipelined color buffers, hi-z), blaster's own worker memory is not
+    visible from here and only shows up in the resident set.
+*/
+struct MemoryReport
+{
+    size_t vbos = 0;
+    size_t meshes = 0;
+    size_t textures = 0;
+    size_t color_buffers = 0;
+    size_t depth_buffer = 0;
+    size_t scratch = 0;
+};
+
+// logs the report, resident and peak resident memory
+void print_memory_report(const MemoryReport& report);
+
+#endif
@@ -0,0 +1,745 @@
+#include "mesh.h"
+#include "pool.h"
+#include "layout.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+#define VALENCE_TABLE_SIZE 32
+
+struct ScoreTables
+{
+    float cache[VERTEX_CACHE_SIZE];
+    float valence[VALENCE_TABLE_SIZE];
+
+    ScoreTables()
+    {
+        for (int n=0;n<VERTEX_CACHE_SIZE;n++) {
+            if (n<3) {
+                // vertices of the last triangle, a fixed score avoids
+                // favouring any of its edges
+                cache[n] = 0.75f;
+            }
+            else {
+                float s = 1.0f - (n-3) / (float)(VERTEX_CACHE_SIZE-3);
+                cache[n] = powf(s,1.5f);
+            }
+        }
+
+        valence[0] = 0.0f;
+
+        for (int n=1;n<VALENCE_TABLE_SIZE;n++) {
+            valence[n] = 2.0f * powf((float)n,-0.5f);
+        }
+    }
+};
+
+static const ScoreTables score_tables;
+
+static float vertex_score(int cache_pos,uint32_t remaining)
+{
+    if (remaining==0) {
+        return -1.0f;
+    }
+
+    float score = (cache_pos>=0) ? score_tables.cache[cache_pos] : 0.0f;
+
+    // boost vertices with few triangles left so they get finished
+    if (remaining<VALENCE_TABLE_SIZE) {
+        score += score_tables.valence[remaining];
+    }
+    else {
+        score += 2.0f * powf((float)remaining,-0.5f);
+    }
+
+    return score;
+}
+
+void optimize_vertex_cache(vector<uint32_t>& indices,size_t vertex_count)
+{
+    size_t tri_count = indices.size()/3;
+
+    if (tri_count==0) {
+        return;
+    }
+
+    // vertex to triangle adjacency
+    vector<uint32_t> offsets(vertex_count+1,0);
+
+    for (size_t n=0;n<tri_count*3;n++) {
+        offsets[indices[n]+1]++;
+    }
+
+    for (size_t n=0;n<vertex_count;n++) {
+        offsets[n+1]+=offsets[n];
+    }
+
+    vector<uint32_t> adjacency(tri_count*3);
+    vector<uint32_t> remaining(vertex_count,0);
+
+    for (size_t n=0;n<tri_count*3;n++) {
+        uint32_t v = indices[n];
+        adjacency[offsets[v]+remaining[v]] = n/3;
+        remaining[v]++;
+    }
+
+    vector<int> cache_pos(vertex_count,-1);
+    vector<float> vscore(vertex_count);
+    vector<float> tscore(tri_count,0.0f);
+    vector<bool> emitted(tri_count,false);
+
+    for (size_t n=0;n<vertex_count;n++) {
+        vscore[n] = vertex_score(-1,remaining[n]);
+    }
+
+    int best = 0;
+
+    for (size_t t=0;t<tri_count;t++) {
+        tscore[t] = vscore[indices[t*3]] + vscore[indices[t*3+1]] + vscore[indices[t*3+2]];
+
+        if (tscore[t]>tscore[best]) {
+            best = t;
+        }
+    }
+
+    vector<uint32_t> out;
+    out.reserve(tri_count*3);
+
+    uint32_t cache[VERTEX_CACHE_SIZE+3];
+    int cache_count = 0;
+    size_t scan = 0;
+
+    while (out.size()<tri_count*3) {
+
+        if (best<0) {
+            // nothing adjacent to the cache, pick next pending triangle
+            while (emitted[scan]) {
+                scan++;
+            }
+
+            best = scan;
+        }
+
+        const uint32_t* tri = &indices[best*3];
+
+        emitted[best] = true;
+        out.push_back(tri[0]);
+        out.push_back(tri[1]);
+        out.push_back(tri[2]);
+
+        for (int k=0;k<3;k++) {
+            uint32_t v = tri[k];
+            uint32_t* list = &adjacency[offsets[v]];
+
+            for (uint32_t i=0;i<remaining[v];i++) {
+                if (list[i]==(uint32_t)best) {
+                    list[i] = list[remaining[v]-1];
+                    break;
+                }
+            }
+
+            remaining[v]--;
+        }
+
+        // emitted vertices move to the front of the lru cache
+        uint32_t new_cache[VERTEX_CACHE_SIZE+3];
+        int new_count = 0;
+
+        for (int k=0;k<3;k++) {
+            bool found = false;
+
+            for (int i=0;i<new_count;i++) {
+                found = found or new_cache[i]==tri[k];
+            }
+
+            if (!found) {
+                new_cache[new_count++] = tri[k];
+            }
+        }
+
+        for (int i=0;i<cache_count;i++) {
+            uint32_t v = cache[i];
+
+            if (v!=tri[0] and v!=tri[1] and v!=tri[2]) {
+                new_cache[new_count++] = v;
+            }
+        }
+
+        for (int i=0;i<new_count;i++) {
+            uint32_t v = new_cache[i];
+            cache_pos[v] = (i<VERTEX_CACHE_SIZE) ? i : -1;
+            vscore[v] = vertex_score(cache_pos[v],remaining[v]);
+        }
+
+        cache_count = (new_count<VERTEX_CACHE_SIZE) ? new_count : VERTEX_CACHE_SIZE;
+
+        for (int i=0;i<cache_count;i++) {
+            cache[i] = new_cache[i];
+        }
+
+        // only triangles touching the cache changed their score
+        best = -1;
+        float best_score = -1.0f;
+
+        for (int i=0;i<new_count;i++) {
+            uint32_t v = new_cache[i];
+            uint32_t* list = &adjacency[offsets[v]];
+
+            for (uint32_t j=0;j<remaining[v];j++) {
+                uint32_t t = list[j];
+
+                tscore[t] = vscore[indices[t*3]] + vscore[indices[t*3+1]] + vscore[indices[t*3+2]];
+
+                if (tscore[t]>best_score) {
+                    best_score = tscore[t];
+                    best = t;
+                }
+            }
+        }
+    }
+
+    indices.swap(out);
+}
+
+size_t simulate_vertex_cache(const vector<uint32_t>& indices,size_t vertex_count,size_t cache_size)
+{
+    // miss counter value when each vertex entered the cache, 0 means never
+    vector<size_t> stamp(vertex_count,0);
+    size_t misses = 0;
+
+    for (uint32_t v : indices) {
+        if (stamp[v]==0 or misses-stamp[v]>=cache_size) {
+            misses++;
+            stamp[v] = misses;
+        }
+    }
+
+    return misses;
+}
+
+bl_vbo_t* build_indexed_vbo(const vector<Vertex>& vertices,const uint32_t* indices,size_t count)
+{
+    bl_vbo_t* vbo = new_vbo<TriangleLayout>(count);
+
+    // every range writes its own slots of the preallocated vbo
+    parallel_for(build_pool(),count,VBO_PARALLEL_GRAIN,[&](size_t begin,size_t end) {
+        gather_vbo<TriangleLayout>(vbo,begin,vertices.data(),indices+begin,end-begin);
+    });
+
+    return vbo;
+}
+
+void finish_primitive(Primitive* prim,const BuildOptions& options)
+{
+    size_t triangles = prim->indices.size()/3;
+    size_t misses = simulate_vertex_cache(prim->indices,prim->vertices.size(),VERTEX_CACHE_SIZE);
+
+    optimize_vertex_cache(prim->indices,prim->vertices.size());
+    prim->cache_misses = simulate_vertex_cache(prim->indices,prim->vertices.size(),VERTEX_CACHE_SIZE);
+
+    clog<<"acmr: "<<misses/(double)triangles<<" -> "<<prim->cache_misses/(double)triangles<<endl;
+
+    if (options.lods) {
+        build_lods(prim);
+    }
+
+    setup_primitive(prim,options);
+}
+
+void setup_primitive(Primitive* prim,const BuildOptions& options)
+{
+    // packed vertices come from the mesh cache or the float ones, every
+    // VBO is then built from their decoded values
+    if (options.quantize) {
+        if (prim->packed.empty()) {
+            quantize_primitive(prim);
+        }
+
+        decode_primitive(prim);
+    }
+
+    prim->vertex_count = prim->vertices.size();
+    prim->index_count = prim->indices.size();
+
+    prim->bounds = compute_bounds(prim->vertices);
+    prim->uv_density = compute_uv_density(prim->vertices,prim->indices);
+
+    if (options.meshlets) {
+        build_meshlets(prim);
+    }
+    else {
+        prim->vbo = build_indexed_vbo(prim->vertices,prim->indices.data(),prim->indices.size());
+    }
+
+    if (options.lods) {
+        for (Lod& lod : prim->lods) {
+            lod.index_count = lod.indices.size();
+            lod.vbo = build_indexed_vbo(prim->vertices,lod.indices.data(),lod.indices.size());
+        }
+    }
+    else {
+        prim->lods.clear();
+    }
+
+    // the packed copy is the one kept, wireframe VBOs decode it when needed
+    if (options.quantize or options.release_vertices) {
+        if (prim->packed.empty()) {
+            quantize_primitive(prim);
+        }
+
+        release_vertices(prim);
+    }
+
+    if (prim->instances.empty()) {
+        Instance instance;
+        instance.transform = glm::mat4(1.0f);
+
+        prim->instances.push_back(instance);
+    }
+
+    for (Instance& instance : prim->instances) {
+        instance.lod = 0;
+    }
+}
+
+void release_vertices(Primitive* prim)
+{
+    vector<Vertex>().swap(prim->vertices);
+
+    for (Lod& lod : prim->lods) {
+        vector<uint32_t>().swap(lod.indices);
+    }
+}
+
+float compute_uv_density(const vector<Vertex>& vertices,const vector<uint32_t>& indices)
+{
+    double area = 0.0;
+    double uv_area = 0.0;
+
+    for (size_t n=0;n+2<indices.size();n+=3) {
+        const Vertex& a = vertices[indices[n]];
+        const Vertex& b = vertices[indices[n+1]];
+        const Vertex& c = vertices[indices[n+2]];
+
+        glm::vec3 e1(b.p.x-a.p.x,b.p.y-a.p.y,b.p.z-a.p.z);
+        glm::vec3 e2(c.p.x-a.p.x,c.p.y-a.p.y,c.p.z-a.p.z);
+
+        area+=glm::length(glm::cross(e1,e2));
+        uv_area+=fabs((b.t.u-a.t.u)*(c.t.v-a.t.v) - (c.t.u-a.t.u)*(b.t.v-a.t.v));
+    }
+
+    if (area<=0.0) {
+        return 0.0f;
+    }
+
+    return sqrt(uv_area/area);
+}
+
+void build_soa_vertices(const vector<Vertex>& vertices,SoaVertices& soa)
+{
+    resize_soa_vertices(soa,vertices.size());
+
+    float* x = soa.array(SoaVertices::X);
+    float* y = soa.array(SoaVertices::Y);
+    float* z = soa.array(SoaVertices::Z);
+    float* nx = soa.array(SoaVertices::NX);
+    float* ny = soa.array(SoaVertices::NY);
+    float* nz = soa.array(SoaVertices::NZ);
+    float* u = soa.array(SoaVertices::U);
+    float* v = soa.array(SoaVertices::V);
+
+    for (size_t n=0;n<vertices.size();n++) {
+        const Vertex& vertex = vertices[n];
+
+        x[n] = vertex.p.x;
+        y[n] = vertex.p.y;
+        z[n] = vertex.p.z;
+        nx[n] = vertex.n.x;
+        ny[n] = vertex.n.y;
+        nz[n] = vertex.n.z;
+        u[n] = vertex.t.u;
+        v[n] = vertex.t.v;
+    }
+}
+
+Bounds compute_bounds(const vector<Vertex>& vertices)
+{
+    Bounds bounds;
+
+    bounds.min = glm::vec3(0.0f);
+    bounds.max = glm::vec3(0.0f);
+    bounds.center = glm::vec3(0.0f);
+    bounds.radius = 0.0f;
+
+    if (vertices.empty()) {
+        return bounds;
+    }
+
+    bounds.min = glm::vec3(vertices[0].p.x,vertices[0].p.y,vertices[0].p.z);
+    bounds.max = bounds.min;
+
+    for (const Vertex& vertex : vertices) {
+        glm::vec3 p(vertex.p.x,vertex.p.y,vertex.p.z);
+
+        bounds.min = glm::min(bounds.min,p);
+        bounds.max = glm::max(bounds.max,p);
+    }
+
+    bounds.center = (bounds.min + bounds.max) * 0.5f;
+
+    float radius2 = 0.0f;
+
+    for (const Vertex& vertex : vertices) {
+        glm::vec3 d = glm::vec3(vertex.p.x,vertex.p.y,vertex.p.z) - bounds.center;
+        float len2 = glm::dot(d,d);
+
+        if (len2>radius2) {
+            radius2 = len2;
+        }
+    }
+
+    bounds.radius = sqrtf(radius2);
+
+    return bounds;
+}
+
+bl_vbo_t* build_points_vbo(Primitive* prim)
+{
+    vector<Vertex> decoded;
+    const vector<Vertex>& vertices = primitive_vertices(prim,decoded);
+    bl_vbo_t* vbo = new_vbo<LineLayout>(vertices.size());
+
+    fill_vbo<LineLayout,LineVertex>(vbo,0,vertices.size(),[&](size_t n) {
+        return LineVertex{vertices[n].p,{0,0,0,0}};
+    });
+
+    return vbo;
+}
+
+struct EdgeInfo
+{
+    uint32_t faces;
+    bool sharp;
+    glm::vec3 normal;
+};
+
+vector<uint32_t> extract_edges(const vector<Vertex>& vertices,const vector<uint32_t>& indices,bool feature_only)
+{
+    const float feature_cos = cosf(FEATURE_EDGE_ANGLE * (float)M_PI / 180.0f);
+
+    // keyed by lower index in the high half, edges keep first seen order
+    unordered_map<uint64_t,EdgeInfo> map;
+    map.reserve(indices.size());
+
+    vector<uint64_t> order;
+    order.reserve(indices.size()/2);
+
+    for (size_t n=0;n+2<indices.size();n+=3) {
+        const bl_vector_t& a = vertices[indices[n]].p;
+        const bl_vector_t& b = vertices[indices[n+1]].p;
+        const bl_vector_t& c = vertices[indices[n+2]].p;
+
+        glm::vec3 normal = glm::cross(glm::vec3(b.x-a.x,b.y-a.y,b.z-a.z),glm::vec3(c.x-a.x,c.y-a.y,c.z-a.z));
+        float len = glm::length(normal);
+
+        if (len>0.0f) {
+            normal = normal/len;
+        }
+
+        for (int k=0;k<3;k++) {
+            uint32_t i0 = indices[n+k];
+            uint32_t i1 = indices[n+(k+1)%3];
+            uint64_t key = ((uint64_t)min(i0,i1)<<32) | max(i0,i1);
+
+            auto it = map.find(key);
+
+            if (it==map.end()) {
+                EdgeInfo info;
+                info.faces = 1;
+                info.sharp = false;
+                info.normal = normal;
+
+                map[key] = info;
+                order.push_back(key);
+            }
+            else {
+                EdgeInfo& info = it->second;
+                info.faces++;
+
+                if (glm::dot(info.normal,normal)<feature_cos) {
+                    info.sharp = true;
+                }
+            }
+        }
+    }
+
+    vector<uint32_t> edges;
+    edges.reserve(order.size()*2);
+
+    for (uint64_t key : order) {
+        const EdgeInfo& info = map[key];
+
+        if (feature_only and info.faces==2 and !info.sharp) {
+            continue;
+        }
+
+        edges.push_back(key>>32);
+        edges.push_back(key & 0xffffffff);
+    }
+
+    return edges;
+}
+
+bl_vbo_t* build_lines_vbo(Primitive* prim,bool feature_only)
+{
+    vector<Vertex> decoded;
+    const vector<Vertex>& vertices = primitive_vertices(prim,decoded);
+    vector<uint32_t> edges = extract_edges(vertices,prim->indices,feature_only);
+
+    bl_vbo_t* vbo = new_vbo<LineLayout>(edges.size());
+
+    fill_vbo<LineLayout,LineVertex>(vbo,0,edges.size(),[&](size_t n) {
+        return LineVertex{vertices[edges[n]].p,{0,0,0,0}};
+    });
+
+    if (feature_only) {
+        prim->feature_lines = edges.size()/2;
+    }
+    else {
+        prim->lines = edges.size()/2;
+    }
+    
+    return vbo;
+}
+
+size_t allocated_vbo_bytes(const vector<Primitive*>& primitives)
+{
+    size_t bytes = 0;
+
+    for (const Primitive* prim : primitives) {
+        if (prim->vbo) {
+            bytes+=prim->index_count*TriangleLayout::stride;
+        }
+
+        for (const Meshlet& meshlet : prim->meshlets) {
+            bytes+=meshlet.count*TriangleLayout::stride;
+        }
+
+        for (const Lod& lod : prim->lods) {
+            if (lod.vbo) {
+                bytes+=lod.index_count*TriangleLayout::stride;
+            }
+        }
+
+        if (prim->points_vbo) {
+            bytes+=prim->vertex_count*LineLayout::stride;
+        }
+
+        if (prim->lines_vbo) {
+            bytes+=prim->lines*2*LineLayout::stride;
+        }
+
+        if (prim->feature_lines_vbo) {
+            bytes+=prim->feature_lines*2*LineLayout::stride;
+        }
+    }
+
+    return bytes;
+}
+
+size_t mesh_bytes(const vector<Primitive*>& primitives)
+{
+    size_t bytes = 0;
+
+    for (const Primitive* prim : primitives) {
+        bytes+=prim->vertices.capacity()*sizeof(Vertex);
+        bytes+=prim->packed.capacity()*sizeof(QuantizedVertex);
+        bytes+=prim->indices.capacity()*sizeof(uint32_t);
+
+        for (const Lod& lod : prim->lods) {
+            bytes+=lod.indices.capacity()*sizeof(uint32_t);
+        }
+    }
+
+    return bytes;
+}
+
+static void setup_meshlet(const Primitive* prim,Meshlet& meshlet)
+{
+    const uint32_t* indices = &prim->indices[meshlet.first];
+
+    glm::vec3 min(prim->vertices[indices[0]].p.x,prim->vertices[indices[0]].p.y,prim->vertices[indices[0]].p.z);
+    glm::vec3 max = min;
+    glm::vec3 normals(0.0f);
+
+    for (uint32_t n=0;n<meshlet.count;n+=3) {
+        glm::vec3 p[3];
+
+        for (int k=0;k<3;k++) {
+            const bl_vector_t& v = prim->vertices[indices[n+k]].p;
+            p[k] = glm::vec3(v.x,v.y,v.z);
+
+            min = glm::min(min,p[k]);
+            max = glm::max(max,p[k]);
+        }
+
+        glm::vec3 normal = glm::cross(p[1]-p[0],p[2]-p[0]);
+        float len = glm::length(normal);
+
+        if (len>0.0f) {
+            normals = normals + normal/len;
+        }
+    }
+
+    meshlet.center = (min + max) * 0.5f;
+    meshlet.radius = 0.0f;
+
+    for (uint32_t n=0;n<meshlet.count;n++) {
+        const bl_vector_t& v = prim->vertices[indices[n]].p;
+        float d = glm::length(glm::vec3(v.x,v.y,v.z) - meshlet.center);
+
+        if (d>meshlet.radius) {
+            meshlet.radius = d;
+        }
+    }
+
+    // cone never culls unless every triangle normal is close to the axis
+    meshlet.cone_axis = glm::vec3(0.0f);
+    meshlet.cone_cutoff = 1.0f;
+
+    float len = glm::length(normals);
+
+    if (len<=0.0f) {
+        return;
+    }
+
+    glm::vec3 axis = normals/len;
+    float min_dp = 1.0f;
+
+    for (uint32_t n=0;n<meshlet.count;n+=3) {
+        glm::vec3 p[3];
+
+        for (int k=0;k<3;k++) {
+            const bl_vector_t& v = prim->vertices[indices[n+k]].p;
+            p[k] = glm::vec3(v.x,v.y,v.z);
+        }
+
+        glm::vec3 normal = glm::cross(p[1]-p[0],p[2]-p[0]);
+        float nlen = glm::length(normal);
+
+        if (nlen>0.0f) {
+            float dp = glm::dot(axis,normal/nlen);
+
+            if (dp<min_dp) {
+                min_dp = dp;
+            }
+        }
+    }
+
+    // a cone wider than ~85 degrees is useless for culling
+    if (min_dp<=0.1f) {
+        return;
+    }
+
+    meshlet.cone_axis = axis;
+    meshlet.cone_cutoff = sqrtf(1.0f - min_dp*min_dp);
+}
+
+void build_lods(Primitive* prim)
+{
+    prim->lods.clear();
+
+    size_t triangles = prim->indices.size()/3;
+    float error = 0.0f;
+
+    while (prim->lods.size()<LOD_MAX_LEVELS and triangles/2>=LOD_MIN_TRIANGLES) {
+        const vector<uint32_t>& source = prim->lods.empty() ? prim->indices : prim->lods.back().indices;
+
+        Lod lod;
+        lod.indices = simplify_mesh(prim->vertices,source,triangles/2,lod.error);
+
+        size_t count = lod.indices.size()/3;
+
+        // mostly locked borders left, not worth another level
+        if (count*5>triangles*4) {
+            break;
+        }
+
+        // quadrics restart on every level, so errors add up along the chain
+        error+=lod.error;
+        lod.error = error;
+
+        optimize_vertex_cache(lod.indices,prim->vertices.size());
+        lod.cache_misses = simulate_vertex_cache(lod.indices,prim->vertices.size(),VERTEX_CACHE_SIZE);
+        lod.vbo = nullptr;
+
+        clog<<"lod "<<prim->lods.size()+1<<": "<<count<<" triangles, error "<<lod.error<<endl;
+
+        prim->lods.push_back(lod);
+        triangles = count;
+    }
+}
+
+void build_meshlets(Primitive* prim)
+{
+    const vector<uint32_t>& indices = prim->indices;
+
+    // meshlet that last took each vertex
+    vector<uint32_t> owner(prim->vertices.size(),0xffffffff);
+
+    Meshlet meshlet = {};
+    uint32_t id = 0;
+
+    for (size_t n=0;n<indices.size();n+=3) {
+        const uint32_t* tri = &indices[n];
+        uint32_t added = 0;
+
+        for (int k=0;k<3;k++) {
+            bool dup = (k>0 and tri[k]==tri[0]) or (k>1 and tri[k]==tri[1]);
+            added += (owner[tri[k]]!=id and !dup);
+        }
+
+        if (meshlet.count/3==MESHLET_MAX_TRIANGLES or meshlet.vertex_count+added>MESHLET_MAX_VERTICES) {
+            prim->meshlets.push_back(meshlet);
+
+            id++;
+            meshlet = Meshlet();
+            meshlet.first = n;
+            meshlet.count = 0;
+            meshlet.vertex_count = 0;
+
+            added = 0;
+
+            for (int k=0;k<3;k++) {
+                bool dup = (k>0 and tri[k]==tri[0]) or (k>1 and tri[k]==tri[1]);
+                added += !dup;
+            }
+        }
+
+        for (int k=0;k<3;k++) {
+            owner[tri[k]] = id;
+        }
+
+        meshlet.vertex_count+=added;
+        meshlet.count+=3;
+    }
+
+    if (meshlet.count>0) {
+        prim->meshlets.push_back(meshlet);
+    }
+
+    vector<Meshlet>& meshlets = prim->meshlets;
+
+    parallel_for(build_pool(),meshlets.size(),MESHLET_PARALLEL_GRAIN,[&](size_t begin,size_t end) {
+        for (size_t n=begin;n<end;n++) {
+            setup_meshlet(prim,meshlets[n]);
+            meshlets[n].vbo = build_indexed_vbo(prim->vertices,&indices[meshlets[n].first],meshlets[n].count);
+        }
+    });
+
+    clog<<"meshlets: "<<prim->meshlets.size()<<endl;
+}
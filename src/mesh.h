@@ -0,0 +1,286 @@
+#ifndef DEMO_MESH_H
+#define DEMO_MESH_H
+
+#include <blaster/vector.h>
+#include <blaster/vbo.h>
+
+#include <glm/glm.hpp>
+
+#include "transform.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct MipTexture;
+
+// post-transform vertex cache size used for reordering and statistics
+#define VERTEX_CACHE_SIZE 32
+
+struct Vertex
+{
+    bl_vector_t p;
+    bl_vector_t n;
+    bl_uv_t t;
+};
+
+// object space axis aligned box and bounding sphere
+struct Bounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+
+    glm::vec3 center;
+    float radius;
+};
+
+// meshlet limits, small enough for a cluster to face mostly one way
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// vertices and meshlets per range when building them on the build pool
+#define VBO_PARALLEL_GRAIN 65536
+#define MESHLET_PARALLEL_GRAIN 64
+
+// dihedral angle, in degrees, above which an edge is a feature edge
+#define FEATURE_EDGE_ANGLE 30.0f
+
+// lod chain limits, every level targets half the triangles of the previous
+#define LOD_MAX_LEVELS 6
+#define LOD_MIN_TRIANGLES 256
+
+// options applied when primitives are set up
+struct BuildOptions
+{
+    // split primitives into meshlets culled one by one
+    bool meshlets = false;
+
+    // build a chain of simplified levels selected by screen space error
+    bool lods = false;
+
+    // keep vertices as QuantizedVertex, decoded only while VBOs are built
+    bool quantize = false;
+
+    // keep only the packed vertices and the indices once the VBOs are
+    // built, the float vertices and lod indices are freed by setup_primitive
+    bool release_vertices = false;
+};
+
+/*
+    16 byte vertex: position in 16 bit steps of the primitive's bounding
+    box, octahedral normal in two snorm16 and uv in 16 bit steps of the
+    primitive's uv range
+*/
+struct QuantizedVertex
+{
+    uint16_t p[3];
+    uint16_t flags;   // QUANTIZED_* bits
+    int16_t n[2];
+    uint16_t t[2];
+};
+
+// the vertex had no normal, n is not meaningful
+#define QUANTIZED_ZERO_NORMAL 1
+
+// decoded value = offset + code * scale, per primitive
+struct Quantization
+{
+    glm::vec3 offset;
+    glm::vec3 scale;
+
+    glm::vec2 uv_offset;
+    glm::vec2 uv_scale;
+};
+
+/*
+    Cluster of consecutive triangles of a primitive with its own VBO. The
+    normal cone allows rejecting clusters that face away from the camera.
+*/
+struct Meshlet
+{
+    // range in Primitive::indices
+    uint32_t first;
+    uint32_t count;
+
+    uint32_t vertex_count;
+
+    glm::vec3 center;
+    float radius;
+
+    glm::vec3 cone_axis;
+    float cone_cutoff;
+
+    bl_vbo_t* vbo;
+};
+
+// simplified version of a primitive, sharing its vertices
+struct Lod
+{
+    // empty when loaded from the mesh cache, only the VBO is kept there
+    std::vector<uint32_t> indices;
+    size_t index_count;
+
+    // object space distance to the full detail surface
+    float error;
+
+    size_t cache_misses;
+
+    bl_vbo_t* vbo;
+};
+
+// placement of a primitive in the scene
+struct Instance
+{
+    glm::mat4 transform;
+
+    // level drawn last frame, 0 is the full detail primitive
+    int lod = 0;
+};
+
+/*
+    Indexed triangle primitive: unique vertices, triangle list indices and
+    the de-indexed VBO built from them for bl_raster_draw
+*/
+struct Primitive
+{
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+
+    // resident copy of the vertices with BuildOptions::quantize or
+    // release_vertices, vertices is left empty once every VBO is built
+    std::vector<QuantizedVertex> packed;
+    Quantization quantization;
+
+    // sizes of vertices and indices, still valid once those are released
+    size_t vertex_count = 0;
+    size_t index_count = 0;
+
+    bl_vbo_t* vbo = nullptr;
+
+    Bounds bounds;
+
+    // empty unless built with BuildOptions::meshlets, vbo is null then
+    std::vector<Meshlet> meshlets;
+
+    // vertices transformed by a VERTEX_CACHE_SIZE fifo cache
+    size_t cache_misses = 0;
+
+    // levels 1 and up, only built with BuildOptions::lods
+    std::vector<Lod> lods;
+
+    // world transforms of every node using it, identity if there are none
+    std::vector<Instance> instances;
+
+    // base color texture, index into the glTF textures or -1
+    int material_texture = -1;
+
+    // uv units per object space unit, averaged over the surface
+    float uv_density = 0.0f;
+
+    // bound by the owner of the textures, not deleted with the primitive
+    MipTexture* texture = nullptr;
+
+    // wireframe and point VBOs, built the first time they are drawn
+    bl_vbo_t* points_vbo = nullptr;
+    bl_vbo_t* lines_vbo = nullptr;
+    bl_vbo_t* feature_lines_vbo = nullptr;
+    size_t lines = 0;
+    size_t feature_lines = 0;
+};
+
+/*
+    Reorders triangles to maximize post-transform cache hits, as described
+    in Tom Forsyth's Linear-Speed Vertex Cache Optimisation
+*/
+void optimize_vertex_cache(std::vector<uint32_t>& indices,size_t vertex_count);
+
+// number of vertex shader invocations for indices going through a fifo cache
+size_t simulate_vertex_cache(const std::vector<uint32_t>& indices,size_t vertex_count,size_t cache_size);
+
+// reorders indices, gathers cache statistics and sets the primitive up
+void finish_primitive(Primitive* prim,const BuildOptions& options);
+
+// computes everything derived from vertices and indices: bounds and VBOs,
+// primitives without instances get a single identity one. Done before the
+// primitive is handed to another thread, nothing in it changes afterwards
+// but the lazily built wireframe VBOs.
+void setup_primitive(Primitive* prim,const BuildOptions& options);
+
+/*
+    Frees the float vertices and the lod indices once every triangle VBO
+    is built. The packed vertices and the indices are kept, the wireframe
+    VBOs and the mesh cache are built from them.
+*/
+void release_vertices(Primitive* prim);
+
+// ranges covering every position and uv of vertices
+Quantization compute_quantization(const std::vector<Vertex>& vertices);
+
+QuantizedVertex quantize_vertex(const Vertex& vertex,const Quantization& q);
+Vertex decode_vertex(const QuantizedVertex& vertex,const Quantization& q);
+
+// unit vector to and from the [-1,1] square of the octahedral mapping
+glm::vec2 encode_octahedral(glm::vec3 n);
+glm::vec3 decode_octahedral(glm::vec2 e);
+
+// fills prim->packed and prim->quantization from prim->vertices
+void quantize_primitive(Primitive* prim);
+
+// replaces prim->vertices with the decoded prim->packed
+void decode_primitive(Primitive* prim);
+
+// float vertices of prim, decoded into decoded when only packed ones are kept
+const std::vector<Vertex>& primitive_vertices(const Primitive* prim,std::vector<Vertex>& decoded);
+
+// bytes of every de-indexed VBO of primitives with vertex_size bytes per vertex
+size_t vbo_bytes(const std::vector<Primitive*>& primitives,size_t vertex_size);
+
+// bytes of the unique vertices of primitives with vertex_size bytes per vertex
+size_t vertex_bytes(const std::vector<Primitive*>& primitives,size_t vertex_size);
+
+// splits vertices into the x,y,z,nx,ny,nz,u,v arrays of soa, the input
+// of the simd transform kernels measured by blaster-transform-bench
+void build_soa_vertices(const std::vector<Vertex>& vertices,SoaVertices& soa);
+
+Bounds compute_bounds(const std::vector<Vertex>& vertices);
+
+// sqrt of uv area over object space area of the triangles
+float compute_uv_density(const std::vector<Vertex>& vertices,const std::vector<uint32_t>& indices);
+
+/*
+    Quadric error edge collapse (Garland and Heckbert) down to target
+    triangles. Collapses only move vertices onto existing ones, so the
+    result indexes the same vertices. Border and seam vertices are locked.
+    error receives the largest collapse distance.
+*/
+std::vector<uint32_t> simplify_mesh(const std::vector<Vertex>& vertices,const std::vector<uint32_t>& indices,size_t target,float& error);
+
+// builds the lod chain of the primitive indices, vbos are not created
+void build_lods(Primitive* prim);
+
+// greedy split of the (cache optimized) triangle order into meshlets
+void build_meshlets(Primitive* prim);
+
+// de-indexes triangles into a TriangleLayout VBO, large ones split over build_pool
+bl_vbo_t* build_indexed_vbo(const std::vector<Vertex>& vertices,const uint32_t* indices,size_t count);
+
+/*
+    Every edge of the triangles once, as index pairs, found through a hash
+    of the sorted indices. With feature_only, only borders, non manifold
+    edges and edges whose faces differ by more than FEATURE_EDGE_ANGLE.
+*/
+std::vector<uint32_t> extract_edges(const std::vector<Vertex>& vertices,const std::vector<uint32_t>& indices,bool feature_only);
+
+// LineLayout VBOs for BL_VBO_POINTS and BL_VBO_LINES, one
+// point per unique vertex and one line per unique edge
+bl_vbo_t* build_points_vbo(Primitive* prim);
+bl_vbo_t* build_lines_vbo(Primitive* prim,bool feature_only);
+
+// bytes of the VBOs created so far, wireframe ones included
+size_t allocated_vbo_bytes(const std::vector<Primitive*>& primitives);
+
+// bytes of the copies kept next to the VBOs: vertices, packed vertices,
+// indices and lods
+size_t mesh_bytes(const std::vector<Primitive*>& primitives);
+
+#endif
@@ -0,0 +1,683 @@
+#include "obj.h"
+#include "mapped.h"
+#include "pool.h"
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+
+using namespace std;
+
+#define OBJ_NONE 0xffffffff
+
+// file bytes per chunk parsed on the build pool
+#define OBJ_CHUNK_BYTES (4*1024*1024)
+
+// position ranges welded independently
+#define OBJ_WELD_BUCKETS 64
+
+struct ObjChunk
+{
+    const char* begin;
+    const char* end;
+
+    size_t v = 0;
+    size_t vt = 0;
+    size_t vn = 0;
+
+    // upper bound from the counting pass, faces may still be rejected
+    size_t triangles = 0;
+
+    size_t first_v = 0;
+    size_t first_vt = 0;
+    size_t first_vn = 0;
+
+    // resolved v,t,n for every triangle corner
+    vector<uint32_t> corners;
+
+    // number of the first corner in the whole file
+    size_t first_corner = 0;
+};
+
+/*
+    Corners whose position falls in one range of positions. Unique v/t/n
+    combinations never cross ranges, so every bucket is welded on its own.
+*/
+struct WeldBucket
+{
+    // file wide corner numbers, in file order
+    vector<uint32_t> corners;
+
+    // v,vt,vn of every unique vertex, in order of first use
+    vector<uint32_t> keys;
+    vector<uint32_t> next;
+
+    size_t first_vertex = 0;
+};
+
+static const double pow10_table[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool is_space(char c)
+{
+    return c==' ' or c=='\t' or c=='\r';
+}
+
+static inline bool is_digit(char c)
+{
+    return c>='0' and c<='9';
+}
+
+static inline const char* skip_spaces(const char* p,const char* end)
+{
+    while (p<end and is_space(*p)) {
+        p++;
+    }
+
+    return p;
+}
+
+static inline const char* next_line(const char* p,const char* end)
+{
+    const char* nl = (const char*)memchr(p,'\n',end-p);
+
+    return nl ? nl+1 : end;
+}
+
+/*
+    from_chars style parsing: no locale, no allocation, returns the first
+    character after the number. Up to 19 significant digits are kept, which
+    is way more than a float can hold.
+*/
+static const char* parse_float(const char* p,const char* end,float& out)
+{
+    p = skip_spaces(p,end);
+
+    bool negative = false;
+
+    if (p<end and (*p=='-' or *p=='+')) {
+        negative = *p=='-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+
+    while (p<end and is_digit(*p)) {
+        if (digits<19) {
+            mantissa = mantissa*10 + (*p-'0');
+            digits += (mantissa>0);
+        }
+        else {
+            exponent++;
+        }
+        p++;
+    }
+
+    if (p<end and *p=='.') {
+        p++;
+
+        while (p<end and is_digit(*p)) {
+            if (digits<19) {
+                mantissa = mantissa*10 + (*p-'0');
+                digits += (mantissa>0);
+                exponent--;
+            }
+            p++;
+        }
+    }
+
+    if (p<end and (*p=='e' or *p=='E')) {
+        p++;
+
+        bool eneg = false;
+
+        if (p<end and (*p=='-' or *p=='+')) {
+            eneg = *p=='-';
+            p++;
+        }
+
+        int e = 0;
+
+        while (p<end and is_digit(*p)) {
+            if (e<10000) {
+                e = e*10 + (*p-'0');
+            }
+            p++;
+        }
+
+        exponent += eneg ? -e : e;
+    }
+
+    double value = mantissa;
+
+    if (exponent<0) {
+        value = (exponent>=-22) ? value/pow10_table[-exponent] : value*pow(10.0,exponent);
+    }
+    else if (exponent>0) {
+        value = (exponent<=22) ? value*pow10_table[exponent] : value*pow(10.0,exponent);
+    }
+
+    out = negative ? -value : value;
+
+    return p;
+}
+
+static inline const char* parse_int(const char* p,const char* end,int64_t& out,bool& valid)
+{
+    bool negative = false;
+
+    if (p<end and (*p=='-' or *p=='+')) {
+        negative = *p=='-';
+        p++;
+    }
+
+    valid = p<end and is_digit(*p);
+
+    int64_t value = 0;
+
+    while (p<end and is_digit(*p)) {
+        value = value*10 + (*p-'0');
+        p++;
+    }
+
+    out = negative ? -value : value;
+
+    return p;
+}
+
+// one based and negative (relative to count) indices to zero based
+static inline uint32_t resolve_index(int64_t index,size_t count)
+{
+    if (index>0) {
+        return index-1;
+    }
+
+    if (index<0 and (int64_t)count+index>=0) {
+        return count+index;
+    }
+
+    return OBJ_NONE;
+}
+
+// parses v, v/t, v//n or v/t/n
+static const char* parse_corner(const char* p,const char* end,ObjChunk& chunk,uint32_t* corner)
+{
+    int64_t index;
+    bool valid;
+
+    corner[0] = OBJ_NONE;
+    corner[1] = OBJ_NONE;
+    corner[2] = OBJ_NONE;
+
+    p = parse_int(p,end,index,valid);
+
+    if (!valid) {
+        return nullptr;
+    }
+
+    corner[0] = resolve_index(index,chunk.first_v+chunk.v);
+
+    if (p<end and *p=='/') {
+        p++;
+
+        if (p<end and *p!='/') {
+            p = parse_int(p,end,index,valid);
+
+            if (valid) {
+                corner[1] = resolve_index(index,chunk.first_vt+chunk.vt);
+            }
+        }
+
+        if (p<end and *p=='/') {
+            p++;
+            p = parse_int(p,end,index,valid);
+
+            if (valid) {
+                corner[2] = resolve_index(index,chunk.first_vn+chunk.vn);
+            }
+        }
+    }
+
+    return p;
+}
+
+// corners of a face line, everything up to eol or a comment
+static size_t count_face_corners(const char* p,const char* eol)
+{
+    size_t count = 0;
+    bool in_corner = false;
+
+    for (;p<eol and *p!='\n' and *p!='#';p++) {
+        bool corner = !is_space(*p);
+
+        count+=(corner and !in_corner);
+        in_corner = corner;
+    }
+
+    return count;
+}
+
+static void count_chunk(ObjChunk& chunk)
+{
+    const char* p = chunk.begin;
+    const char* end = chunk.end;
+
+    while (p<end) {
+        p = skip_spaces(p,end);
+        const char* eol = next_line(p,end);
+
+        if (p+1<end and p[0]=='v') {
+            if (is_space(p[1])) {
+                chunk.v++;
+            }
+            else if (p[1]=='t') {
+                chunk.vt++;
+            }
+            else if (p[1]=='n') {
+                chunk.vn++;
+            }
+        }
+        else if (p+1<end and p[0]=='f' and is_space(p[1])) {
+            size_t corners = count_face_corners(p+1,eol);
+
+            chunk.triangles+=(corners>2) ? corners-2 : 0;
+        }
+
+        p = eol;
+    }
+}
+
+/*
+    Parses the chunk into positions, normals and uvs, indexed from the
+    chunk first_ values. Triangles using a position outside of total_v are
+    dropped and uv or normal slots outside of theirs are left empty.
+*/
+static void parse_chunk(ObjChunk& chunk,float* positions,float* normals,float* uvs,size_t total_v,size_t total_vt,size_t total_vn)
+{
+    const char* p = chunk.begin;
+    const char* end = chunk.end;
+
+    chunk.corners.reserve(chunk.triangles*9);
+
+    // counters are rebuilt while parsing so relative indices resolve
+    chunk.v = 0;
+    chunk.vt = 0;
+    chunk.vn = 0;
+
+    while (p<end) {
+        p = skip_spaces(p,end);
+        const char* eol = next_line(p,end);
+
+        if (p+1<end and p[0]=='v') {
+            if (is_space(p[1])) {
+                float* out = positions + (chunk.first_v+chunk.v)*3;
+                p = parse_float(p+1,eol,out[0]);
+                p = parse_float(p,eol,out[1]);
+                p = parse_float(p,eol,out[2]);
+                chunk.v++;
+            }
+            else if (p[1]=='t') {
+                float* out = uvs + (chunk.first_vt+chunk.vt)*2;
+                p = parse_float(p+2,eol,out[0]);
+                p = parse_float(p,eol,out[1]);
+                chunk.vt++;
+            }
+            else if (p[1]=='n') {
+                float* out = normals + (chunk.first_vn+chunk.vn)*3;
+                p = parse_float(p+2,eol,out[0]);
+                p = parse_float(p,eol,out[1]);
+                p = parse_float(p,eol,out[2]);
+                chunk.vn++;
+            }
+        }
+        else if (p+1<end and p[0]=='f' and is_space(p[1])) {
+            uint32_t first[3];
+            uint32_t prev[3];
+            uint32_t corner[3];
+            int count = 0;
+
+            p++;
+
+            while (true) {
+                p = skip_spaces(p,eol);
+
+                if (p>=eol or *p=='\n' or *p=='#') {
+                    break;
+                }
+
+                p = parse_corner(p,eol,chunk,corner);
+
+                if (!p) {
+                    break;
+                }
+
+                corner[1] = (corner[1]<total_vt) ? corner[1] : OBJ_NONE;
+                corner[2] = (corner[2]<total_vn) ? corner[2] : OBJ_NONE;
+
+                if (count==0) {
+                    memcpy(first,corner,sizeof(corner));
+                }
+                else if (count>=2 and first[0]<total_v and prev[0]<total_v and corner[0]<total_v) {
+                    // fan triangulation
+                    chunk.corners.insert(chunk.corners.end(),first,first+3);
+                    chunk.corners.insert(chunk.corners.end(),prev,prev+3);
+                    chunk.corners.insert(chunk.corners.end(),corner,corner+3);
+                }
+
+                memcpy(prev,corner,sizeof(corner));
+                count++;
+            }
+        }
+
+        p = eol;
+    }
+}
+
+static size_t weld_bucket_of(uint32_t v,size_t total_v)
+{
+    return (size_t)((uint64_t)v*OBJ_WELD_BUCKETS/total_v);
+}
+
+/*
+    Gives every corner of the bucket the number, within the bucket, of its
+    v/t/n combination. Combinations sharing the same position are chained
+    from head, most positions have only one. Buckets cover disjoint
+    positions, so they share head without locking.
+*/
+static void weld_bucket(WeldBucket& bucket,const vector<ObjChunk>& chunks,vector<uint32_t>& head,vector<uint32_t>& corner_vertex)
+{
+    size_t c = 0;
+
+    for (uint32_t g : bucket.corners) {
+        // corners are in file order, so chunks are only walked forward
+        while (g>=chunks[c].first_corner+chunks[c].corners.size()/3) {
+            c++;
+        }
+
+        const uint32_t* corner = &chunks[c].corners[(g-chunks[c].first_corner)*3];
+
+        uint32_t v = corner[0];
+        uint32_t vt = corner[1];
+        uint32_t vn = corner[2];
+
+        uint32_t index = head[v];
+
+        while (index!=OBJ_NONE and (bucket.keys[index*3+1]!=vt or bucket.keys[index*3+2]!=vn)) {
+            index = bucket.next[index];
+        }
+
+        if (index==OBJ_NONE) {
+            index = bucket.next.size();
+
+            bucket.keys.insert(bucket.keys.end(),{v,vt,vn});
+            bucket.next.push_back(head[v]);
+            head[v] = index;
+        }
+
+        corner_vertex[g] = index;
+    }
+}
+
+bool is_obj(const char* filename)
+{
+    size_t len = strlen(filename);
+
+    return len>4 and filename[len-4]=='.' and
+           tolower(filename[len-3])=='o' and
+           tolower(filename[len-2])=='b' and
+           tolower(filename[len-1])=='j';
+}
+
+bool load_obj(const char* filename,vector<Primitive*>& primitives,const BuildOptions& options)
+{
+    clog<<"loading: "<<filename<<endl;
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    MappedFile file;
+
+    if (!file.open(filename)) {
+        clog<<"Failed to open OBJ: "<<filename<<endl;
+        return false;
+    }
+
+    const char* data = (const char*)file.data;
+    const char* data_end = data + file.size;
+
+    ThreadPool& pool = build_pool();
+
+    // chunks always start at a line
+    size_t chunk_count = max((size_t)1,file.size/OBJ_CHUNK_BYTES);
+    vector<ObjChunk> chunks(chunk_count);
+    const char* p = data;
+
+    for (size_t n=0;n<chunk_count;n++) {
+        chunks[n].begin = p;
+
+        if (n+1==chunk_count) {
+            p = data_end;
+        }
+        else {
+            const char* split = data + (file.size*(n+1))/chunk_count;
+            p = (split>p) ? next_line(split,data_end) : p;
+        }
+
+        chunks[n].end = p;
+    }
+
+    parallel_for(pool,chunks.size(),1,[&](size_t begin,size_t end) {
+        for (size_t n=begin;n<end;n++) {
+            count_chunk(chunks[n]);
+        }
+    });
+
+    size_t total_v = 0;
+    size_t total_vt = 0;
+    size_t total_vn = 0;
+
+    for (ObjChunk& chunk : chunks) {
+        chunk.first_v = total_v;
+        chunk.first_vt = total_vt;
+        chunk.first_vn = total_vn;
+
+        total_v+=chunk.v;
+        total_vt+=chunk.vt;
+        total_vn+=chunk.vn;
+    }
+
+    vector<float> positions(total_v*3);
+    vector<float> normals(total_vn*3);
+    vector<float> uvs(total_vt*2);
+
+    parallel_for(pool,chunks.size(),1,[&](size_t begin,size_t end) {
+        for (size_t n=begin;n<end;n++) {
+            parse_chunk(chunks[n],positions.data(),normals.data(),uvs.data(),total_v,total_vt,total_vn);
+        }
+    });
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    size_t corner_count = 0;
+
+    for (ObjChunk& chunk : chunks) {
+        chunk.first_corner = corner_count;
+        corner_count+=chunk.corners.size()/3;
+    }
+
+    /*
+        A vertex is a unique v/t/n combination. Corners are split by
+        position range, every range is welded on the pool, and vertices
+        end up numbered range after range.
+    */
+    vector<size_t> starts(chunks.size()*OBJ_WELD_BUCKETS,0);
+
+    parallel_for(pool,chunks.size(),1,[&](size_t begin,size_t end) {
+        for (size_t c=begin;c<end;c++) {
+            const vector<uint32_t>& corners = chunks[c].corners;
+            size_t* counts = &starts[c*OBJ_WELD_BUCKETS];
+
+            for (size_t n=0;n<corners.size();n+=3) {
+                counts[weld_bucket_of(corners[n],total_v)]++;
+            }
+        }
+    });
+
+    // counts become where every chunk starts in every bucket
+    vector<WeldBucket> buckets(OBJ_WELD_BUCKETS);
+
+    for (size_t b=0;b<OBJ_WELD_BUCKETS;b++) {
+        size_t total = 0;
+
+        for (size_t c=0;c<chunks.size();c++) {
+            size_t count = starts[c*OBJ_WELD_BUCKETS+b];
+
+            starts[c*OBJ_WELD_BUCKETS+b] = total;
+            total+=count;
+        }
+
+        buckets[b].corners.resize(total);
+    }
+
+    parallel_for(pool,chunks.size(),1,[&](size_t begin,size_t end) {
+        for (size_t c=begin;c<end;c++) {
+            const vector<uint32_t>& corners = chunks[c].corners;
+            size_t* next = &starts[c*OBJ_WELD_BUCKETS];
+
+            for (size_t n=0;n<corners.size();n+=3) {
+                size_t b = weld_bucket_of(corners[n],total_v);
+
+                buckets[b].corners[next[b]++] = chunks[c].first_corner + n/3;
+            }
+        }
+    });
+
+    vector<uint32_t> head(total_v,OBJ_NONE);
+    vector<uint32_t> corner_vertex(corner_count);
+
+    parallel_for(pool,buckets.size(),1,[&](size_t begin,size_t end) {
+        for (size_t b=begin;b<end;b++) {
+            weld_bucket(buckets[b],chunks,head,corner_vertex);
+        }
+    });
+
+    size_t vertex_count = 0;
+
+    for (WeldBucket& bucket : buckets) {
+        bucket.first_vertex = vertex_count;
+        vertex_count+=bucket.next.size();
+    }
+
+    Primitive* prim = new Primitive();
+    prim->vertices.resize(vertex_count);
+    prim->indices.resize(corner_count);
+
+    // bytes rather than vector<bool>, written from several threads
+    vector<uint8_t> computed_normal(vertex_count);
+
+    parallel_for(pool,buckets.size(),1,[&](size_t begin,size_t end) {
+        for (size_t b=begin;b<end;b++) {
+            const WeldBucket& bucket = buckets[b];
+
+            for (size_t n=0;n<bucket.next.size();n++) {
+                uint32_t v = bucket.keys[n*3];
+                uint32_t vt = bucket.keys[n*3+1];
+                uint32_t vn = bucket.keys[n*3+2];
+
+                Vertex& vertex = prim->vertices[bucket.first_vertex+n];
+                vertex.p = {positions[v*3],positions[v*3+1],positions[v*3+2],1.0f};
+                vertex.n = {0,0,0,0};
+                vertex.t = {0,0};
+
+                if (vn!=OBJ_NONE) {
+                    vertex.n = {normals[vn*3],normals[vn*3+1],normals[vn*3+2],0.0f};
+                    bl_vector_normalize(&vertex.n);
+                }
+
+                if (vt!=OBJ_NONE) {
+                    vertex.t = {uvs[vt*2],uvs[vt*2+1]};
+                }
+
+                computed_normal[bucket.first_vertex+n] = vn==OBJ_NONE;
+            }
+        }
+    });
+
+    parallel_for(pool,chunks.size(),1,[&](size_t begin,size_t end) {
+        for (size_t c=begin;c<end;c++) {
+            ObjChunk& chunk = chunks[c];
+
+            for (size_t n=0;n<chunk.corners.size();n+=3) {
+                size_t g = chunk.first_corner + n/3;
+                const WeldBucket& bucket = buckets[weld_bucket_of(chunk.corners[n],total_v)];
+
+                prim->indices[g] = bucket.first_vertex + corner_vertex[g];
+            }
+
+            vector<uint32_t>().swap(chunk.corners);
+        }
+    });
+
+    // area weighted face normals for vertices without one
+    for (size_t n=0;n<prim->indices.size();n+=3) {
+        uint32_t a = prim->indices[n];
+        uint32_t b = prim->indices[n+1];
+        uint32_t c = prim->indices[n+2];
+
+        if (!(computed_normal[a] or computed_normal[b] or computed_normal[c])) {
+            continue;
+        }
+
+        const bl_vector_t& pa = prim->vertices[a].p;
+        const bl_vector_t& pb = prim->vertices[b].p;
+        const bl_vector_t& pc = prim->vertices[c].p;
+
+        float ux = pb.x-pa.x, uy = pb.y-pa.y, uz = pb.z-pa.z;
+        float vx = pc.x-pa.x, vy = pc.y-pa.y, vz = pc.z-pa.z;
+
+        float nx = uy*vz - uz*vy;
+        float ny = uz*vx - ux*vz;
+        float nz = ux*vy - uy*vx;
+
+        uint32_t tri[3] = {a,b,c};
+
+        for (uint32_t v : tri) {
+            if (computed_normal[v]) {
+                prim->vertices[v].n.x+=nx;
+                prim->vertices[v].n.y+=ny;
+                prim->vertices[v].n.z+=nz;
+            }
+        }
+    }
+
+    for (size_t n=0;n<prim->vertices.size();n++) {
+        bl_vector_t& normal = prim->vertices[n].n;
+
+        if (computed_normal[n] and (normal.x!=0 or normal.y!=0 or normal.z!=0)) {
+            bl_vector_normalize(&normal);
+        }
+    }
+
+    auto t2 = std::chrono::steady_clock::now();
+
+    clog<<"vertices: "<<prim->vertices.size()<<endl;
+    clog<<"triangles: "<<prim->indices.size()/3<<endl;
+    clog<<"parse time: "<<std::chrono::duration_cast<std::chrono::milliseconds>(t1-t0).count()<<" ms ("<<chunk_count<<" chunks, "<<pool.threads.size()+1<<" threads)"<<endl;
+    clog<<"weld time: "<<std::chrono::duration_cast<std::chrono::milliseconds>(t2-t1).count()<<" ms"<<endl;
+
+    if (prim->indices.empty()) {
+        delete prim;
+        return true;
+    }
+
+    finish_primitive(prim,options);
+
+    primitives.push_back(prim);
+
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef DEMO_OBJ_H
+#define DEMO_OBJ_H
+
+#include "mesh.h"
+
+#include <vector>
+
+// true when filename ends in .obj, any case
+bool is_obj(const char* filename);
+
+/*
+    Loads a Wavefront OBJ as a single primitive. The file is memory mapped,
+    parsed in chunks and welded by position range on build_pool. Faces may be polygons of any size (fan
+    triangulated), indices may be negative, uv and normal slots are optional
+    and missing normals are computed from the faces.
+*/
+bool load_obj(const char* filename,std::vector<Primitive*>& primitives,const BuildOptions& options);
+
+#endif
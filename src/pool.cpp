@@ -0,0 +1,145 @@
+#include "pool.h"
+
+#include <iostream>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+static void pool_thread(ThreadPool* pool)
+{
+    while (true) {
+        function<void()> task;
+
+        {
+            unique_lock<mutex> guard(pool->lock);
+            pool->wake.wait(guard,[pool]() { return pool->quit or !pool->tasks.empty(); });
+
+            if (pool->tasks.empty()) {
+                return;
+            }
+
+            task = std::move(pool->tasks.front());
+            pool->tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+ThreadPool::ThreadPool(int count)
+{
+    for (int n=0;n<count;n++) {
+        threads.push_back(thread(pool_thread,this));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        quit = true;
+    }
+
+    wake.notify_all();
+
+    for (thread& t : threads) {
+        t.join();
+    }
+}
+
+void pool_submit(ThreadPool& pool,const function<void()>& task)
+{
+    {
+        lock_guard<mutex> guard(pool.lock);
+        pool.tasks.push_back(task);
+    }
+
+    pool.wake.notify_one();
+}
+
+ThreadPool& build_pool()
+{
+    static ThreadPool pool([]() -> int {
+        int count = std::thread::hardware_concurrency();
+        const char* env = getenv("BLASTER_BUILD_THREADS");
+
+        if (env and atoi(env)>0) {
+            count = atoi(env);
+        }
+
+        count = max(1,count);
+        clog<<"build threads: "<<count<<endl;
+
+        // the thread calling parallel_for is one of them
+        return count-1;
+    }());
+
+    return pool;
+}
+
+// ranges are claimed through next, done counts finished items
+struct ParallelJob
+{
+    atomic<size_t> next;
+    atomic<size_t> done;
+
+    size_t count;
+    size_t grain;
+    const function<void(size_t,size_t)>* fn;
+};
+
+static void run_ranges(ParallelJob& job)
+{
+    while (true) {
+        size_t begin = job.next.fetch_add(job.grain);
+
+        if (begin>=job.count) {
+            return;
+        }
+
+        size_t end = min(begin+job.grain,job.count);
+        (*job.fn)(begin,end);
+
+        job.done.fetch_add(end-begin,std::memory_order_release);
+    }
+}
+
+void parallel_for(ThreadPool& pool,size_t count,size_t grain,const function<void(size_t,size_t)>& fn)
+{
+    grain = max((size_t)1,grain);
+    size_t ranges = (count+grain-1)/grain;
+
+    if (ranges<=1 or pool.threads.empty()) {
+        if (count>0) {
+            fn(0,count);
+        }
+
+        return;
+    }
+
+    // helpers may pick their task up after the loop is over, they share the job
+    shared_ptr<ParallelJob> job = make_shared<ParallelJob>();
+    job->next = 0;
+    job->done = 0;
+    job->count = count;
+    job->grain = grain;
+    job->fn = &fn;
+
+    size_t helpers = min(ranges-1,pool.threads.size());
+
+    for (size_t n=0;n<helpers;n++) {
+        pool_submit(pool,[job]() {
+            run_ranges(*job);
+        });
+    }
+
+    run_ranges(*job);
+
+    // ranges still running on other threads
+    while (job->done.load(std::memory_order_acquire)<count) {
+        std::this_thread::yield();
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef DEMO_POOL_H
+#define DEMO_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstddef>
+
+/*
+    Fixed set of threads running queued tasks, for load time work and the
+    per frame Hi-Z reduction. Tasks
+    may use parallel_for themselves, the caller always takes part in the
+    loop so nested loops make progress even when every thread is busy.
+*/
+struct ThreadPool
+{
+    std::vector<std::thread> threads;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<std::function<void()> > tasks;
+    bool quit = false;
+
+    explicit ThreadPool(int count);
+    ~ThreadPool();
+};
+
+void pool_submit(ThreadPool& pool,const std::function<void()>& task);
+
+/*
+    Shared pool used when building primitives, hardware_concurrency-1
+    threads or $BLASTER_BUILD_THREADS-1 when set, 1 disables threading
+*/
+ThreadPool& build_pool();
+
+/*
+    Calls fn(begin,end) over [0,count) in ranges of grain items spread over
+    the pool and the calling thread, returns once every range is done
+*/
+void parallel_for(ThreadPool& pool,size_t count,size_t grain,const std::function<void(size_t,size_t)>& fn);
+
+#endif
@@ -0,0 +1,198 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <fstream>
+#include <cmath>
+
+using namespace std;
+
+static const char* phase_names[PHASE_COUNT] = {
+    "input",
+    "clear",
+    "draw",
+    "update",
+    "upload",
+    "present"
+};
+
+Profiler::Profiler()
+{
+    origin = std::chrono::steady_clock::now();
+    ring.resize(PROFILE_RING_SIZE);
+}
+
+uint64_t profiler_time(const Profiler& profiler,std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(t-profiler.origin).count();
+}
+
+uint64_t profiler_now(const Profiler& profiler)
+{
+    return profiler_time(profiler,std::chrono::steady_clock::now());
+}
+
+void record_phase(FrameRecord& record,Phase phase,uint64_t begin,uint64_t end)
+{
+    record.phase_begin[phase] = begin;
+    record.phase_end[phase] = end;
+}
+
+void record_workers(FrameRecord& record,bl_raster_t* raster)
+{
+    int num_workers = raster->draw_workers + raster->update_workers;
+
+    record.workers.resize(num_workers);
+
+    for (int n=0;n<num_workers;n++) {
+        WorkerTime& wt = record.workers[n];
+
+        wt.type = raster->workers[n]->type;
+        wt.wait = raster->workers[n]->time.wait;
+        wt.work = raster->workers[n]->time.work;
+
+        // a worker with no job this frame still holds last frame stamps
+        wt.start = 0;
+        wt.last = 0;
+
+        if (raster->workers[n]->time.start>=raster->start) {
+            wt.start = raster->workers[n]->time.start - raster->start;
+        }
+
+        if (raster->workers[n]->time.last>=raster->start) {
+            wt.last = raster->workers[n]->time.last - raster->start;
+        }
+
+        raster->workers[n]->time.wait=0;
+        raster->workers[n]->time.work=0;
+    }
+}
+
+void profiler_push(Profiler& profiler,const FrameRecord& record)
+{
+    profiler.ring[profiler.frames%PROFILE_RING_SIZE] = record;
+    profiler.frames++;
+
+    if (profiler.trace) {
+        profiler.history.push_back(record);
+    }
+}
+
+Percentiles profiler_percentiles(const Profiler& profiler)
+{
+    size_t count = min(profiler.frames,(size_t)PROFILE_RING_SIZE);
+    vector<double> values(count);
+
+    for (size_t n=0;n<count;n++) {
+        const FrameRecord& record = profiler.ring[n];
+        values[n] = record.end - record.start;
+    }
+
+    return compute_percentiles(values);
+}
+
+static double nearest_rank(vector<double>& values,double p)
+{
+    size_t rank = (size_t)ceil(p*values.size());
+    size_t index = (rank>0) ? rank-1 : 0;
+
+    nth_element(values.begin(),values.begin()+index,values.end());
+
+    return values[index];
+}
+
+Percentiles compute_percentiles(vector<double>& values)
+{
+    Percentiles result;
+
+    result.count = values.size();
+
+    if (values.empty()) {
+        return result;
+    }
+
+    result.p50 = nearest_rank(values,0.50);
+    result.p95 = nearest_rank(values,0.95);
+    result.p99 = nearest_rank(values,0.99);
+    result.max = *max_element(values.begin(),values.end());
+
+    return result;
+}
+
+static void write_event(ostream& os,bool& first,const char* name,int tid,uint64_t ts,uint64_t dur,size_t frame)
+{
+    os<<(first ? "" : ",\n")
+      <<"{\"name\": \""<<name<<"\", \"ph\": \"X\", \"pid\": 1, \"tid\": "<<tid
+      <<", \"ts\": "<<ts<<", \"dur\": "<<dur
+      <<", \"args\": {\"frame\": "<<frame<<"}}";
+
+    first = false;
+}
+
+static void write_thread_name(ostream& os,bool& first,int tid,const string& name)
+{
+    os<<(first ? "" : ",\n")
+      <<"{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "<<tid
+      <<", \"args\": {\"name\": \""<<name<<"\"}}";
+
+    first = false;
+}
+
+/*
+    blaster keeps only the total wait and work of a worker plus the time of
+    its first and last job, so each worker shows its work followed by its
+    wait, clipped to the span between the two stamps
+*/
+bool write_trace(const char* filename,const vector<FrameRecord>& frames)
+{
+    ofstream fs(filename);
+
+    if (!fs.is_open()) {
+        return false;
+    }
+
+    bool first = true;
+
+    fs<<"{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+
+    write_thread_name(fs,first,0,"main");
+
+    if (!frames.empty()) {
+        for (size_t n=0;n<frames[0].workers.size();n++) {
+            string type = (frames[0].workers[n].type==1) ? "update" : "draw";
+            write_thread_name(fs,first,n+1,type + " worker " + to_string(n));
+        }
+    }
+
+    for (size_t f=0;f<frames.size();f++) {
+        const FrameRecord& record = frames[f];
+
+        write_event(fs,first,"frame",0,record.start,record.end-record.start,f);
+
+        for (int p=0;p<PHASE_COUNT;p++) {
+            if (record.phase_end[p]>record.phase_begin[p]) {
+                write_event(fs,first,phase_names[p],0,record.phase_begin[p],record.phase_end[p]-record.phase_begin[p],f);
+            }
+        }
+
+        for (size_t n=0;n<record.workers.size();n++) {
+            const WorkerTime& wt = record.workers[n];
+
+            uint64_t begin = record.raster_start + wt.start;
+            uint64_t span = (wt.last>wt.start) ? wt.last-wt.start : wt.work+wt.wait;
+            uint64_t work = min(wt.work,span);
+            uint64_t wait = min(wt.wait,span-work);
+
+            if (work>0) {
+                write_event(fs,first,"work",n+1,begin,work,f);
+            }
+
+            if (wait>0) {
+                write_event(fs,first,"wait",n+1,begin+work,wait,f);
+            }
+        }
+    }
+
+    fs<<"\n]}\n";
+
+    return !fs.fail();
+}
@@ -0,0 +1,99 @@
+#ifndef DEMO_PROFILE_H
+#define DEMO_PROFILE_H
+
+#include <blaster/raster.h>
+
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+// frames kept for percentiles
+#define PROFILE_RING_SIZE 1024
+
+// main thread phases of a frame
+enum Phase {
+    PHASE_INPUT,
+    PHASE_CLEAR,
+    PHASE_DRAW,
+    PHASE_UPDATE,
+    PHASE_UPLOAD,
+    PHASE_PRESENT,
+    PHASE_COUNT
+};
+
+// one frame of a raster worker, start and last are relative to raster->start
+struct WorkerTime
+{
+    int type;
+    uint64_t wait;
+    uint64_t work;
+    uint64_t start;
+    uint64_t last;
+};
+
+/*
+    Timings of one frame. Times are microseconds since the profiler was
+    created, phases that did not run this frame have zero length.
+*/
+struct FrameRecord
+{
+    uint64_t start = 0;
+    uint64_t end = 0;
+
+    // raster->start on the profiler clock, origin of worker times
+    uint64_t raster_start = 0;
+
+    uint64_t phase_begin[PHASE_COUNT] = {};
+    uint64_t phase_end[PHASE_COUNT] = {};
+
+    std::vector<WorkerTime> workers;
+};
+
+struct Percentiles
+{
+    double p50 = 0;
+    double p95 = 0;
+    double p99 = 0;
+    double max = 0;
+    size_t count = 0;
+};
+
+/*
+    Ring of the last PROFILE_RING_SIZE frames. When tracing, every frame is
+    kept as well until the trace is written.
+*/
+struct Profiler
+{
+    std::chrono::steady_clock::time_point origin;
+
+    std::vector<FrameRecord> ring;
+    size_t frames = 0;
+
+    bool trace = false;
+    std::vector<FrameRecord> history;
+
+    Profiler();
+};
+
+// microseconds since the profiler origin
+uint64_t profiler_time(const Profiler& profiler,std::chrono::steady_clock::time_point t);
+uint64_t profiler_now(const Profiler& profiler);
+
+void record_phase(FrameRecord& record,Phase phase,uint64_t begin,uint64_t end);
+
+// copies this frame worker times into record and resets them in the raster
+void record_workers(FrameRecord& record,bl_raster_t* raster);
+
+void profiler_push(Profiler& profiler,const FrameRecord& record);
+
+// of the whole frame time of the frames in the ring
+Percentiles profiler_percentiles(const Profiler& profiler);
+
+// nearest rank percentiles, values get reordered
+Percentiles compute_percentiles(std::vector<double>& values);
+
+// trace event json, for chrome://tracing or Perfetto
+bool write_trace(const char* filename,const std::vector<FrameRecord>& frames);
+
+#endif
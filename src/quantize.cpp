@@ -0,0 +1,202 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+static uint16_t unorm16(float value,float offset,float scale)
+{
+    if (scale<=0.0f) {
+        return 0;
+    }
+
+    float code = roundf((value-offset)/scale);
+
+    return (uint16_t)min(65535.0f,max(0.0f,code));
+}
+
+static int16_t snorm16(float value)
+{
+    return (int16_t)roundf(min(1.0f,max(-1.0f,value))*32767.0f);
+}
+
+Quantization compute_quantization(const vector<Vertex>& vertices)
+{
+    Quantization q;
+
+    q.offset = glm::vec3(0.0f);
+    q.scale = glm::vec3(0.0f);
+    q.uv_offset = glm::vec2(0.0f);
+    q.uv_scale = glm::vec2(0.0f);
+
+    if (vertices.empty()) {
+        return q;
+    }
+
+    glm::vec3 pmin(vertices[0].p.x,vertices[0].p.y,vertices[0].p.z);
+    glm::vec3 pmax = pmin;
+    glm::vec2 tmin(vertices[0].t.u,vertices[0].t.v);
+    glm::vec2 tmax = tmin;
+
+    for (const Vertex& vertex : vertices) {
+        glm::vec3 p(vertex.p.x,vertex.p.y,vertex.p.z);
+        glm::vec2 t(vertex.t.u,vertex.t.v);
+
+        pmin = glm::min(pmin,p);
+        pmax = glm::max(pmax,p);
+        tmin = glm::min(tmin,t);
+        tmax = glm::max(tmax,t);
+    }
+
+    q.offset = pmin;
+    q.scale = (pmax-pmin) / 65535.0f;
+    q.uv_offset = tmin;
+    q.uv_scale = (tmax-tmin) / 65535.0f;
+
+    return q;
+}
+
+glm::vec2 encode_octahedral(glm::vec3 n)
+{
+    float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+
+    if (l1==0.0f) {
+        return glm::vec2(0.0f);
+    }
+
+    glm::vec2 e(n.x/l1,n.y/l1);
+
+    // lower hemisphere folds over the diagonals
+    if (n.z<0.0f) {
+        glm::vec2 f((1.0f-fabsf(e.y)) * (e.x>=0.0f ? 1.0f : -1.0f),
+                    (1.0f-fabsf(e.x)) * (e.y>=0.0f ? 1.0f : -1.0f));
+        e = f;
+    }
+
+    return e;
+}
+
+glm::vec3 decode_octahedral(glm::vec2 e)
+{
+    glm::vec3 n(e.x,e.y,1.0f-fabsf(e.x)-fabsf(e.y));
+
+    if (n.z<0.0f) {
+        float x = (1.0f-fabsf(e.y)) * (e.x>=0.0f ? 1.0f : -1.0f);
+        float y = (1.0f-fabsf(e.x)) * (e.y>=0.0f ? 1.0f : -1.0f);
+
+        n.x = x;
+        n.y = y;
+    }
+
+    float l = glm::length(n);
+
+    return (l>0.0f) ? n/l : n;
+}
+
+QuantizedVertex quantize_vertex(const Vertex& vertex,const Quantization& q)
+{
+    QuantizedVertex qv;
+
+    qv.p[0] = unorm16(vertex.p.x,q.offset.x,q.scale.x);
+    qv.p[1] = unorm16(vertex.p.y,q.offset.y,q.scale.y);
+    qv.p[2] = unorm16(vertex.p.z,q.offset.z,q.scale.z);
+    glm::vec3 n(vertex.n.x,vertex.n.y,vertex.n.z);
+
+    // code (0,0) is +z, missing normals are told apart by a flag
+    qv.flags = (n.x==0.0f and n.y==0.0f and n.z==0.0f) ? QUANTIZED_ZERO_NORMAL : 0;
+
+    glm::vec2 e = encode_octahedral(n);
+    qv.n[0] = snorm16(e.x);
+    qv.n[1] = snorm16(e.y);
+
+    qv.t[0] = unorm16(vertex.t.u,q.uv_offset.x,q.uv_scale.x);
+    qv.t[1] = unorm16(vertex.t.v,q.uv_offset.y,q.uv_scale.y);
+
+    return qv;
+}
+
+Vertex decode_vertex(const QuantizedVertex& qv,const Quantization& q)
+{
+    Vertex vertex;
+
+    vertex.p.x = q.offset.x + qv.p[0]*q.scale.x;
+    vertex.p.y = q.offset.y + qv.p[1]*q.scale.y;
+    vertex.p.z = q.offset.z + qv.p[2]*q.scale.z;
+    vertex.p.w = 1.0f;
+
+    if (qv.flags & QUANTIZED_ZERO_NORMAL) {
+        vertex.n = {0.0f,0.0f,0.0f,0.0f};
+    }
+    else {
+        glm::vec3 n = decode_octahedral(glm::vec2(qv.n[0]/32767.0f,qv.n[1]/32767.0f));
+        vertex.n = {n.x,n.y,n.z,0.0f};
+    }
+
+    vertex.t.u = q.uv_offset.x + qv.t[0]*q.uv_scale.x;
+    vertex.t.v = q.uv_offset.y + qv.t[1]*q.uv_scale.y;
+
+    return vertex;
+}
+
+void quantize_primitive(Primitive* prim)
+{
+    prim->quantization = compute_quantization(prim->vertices);
+    prim->packed.resize(prim->vertices.size());
+
+    for (size_t n=0;n<prim->vertices.size();n++) {
+        prim->packed[n] = quantize_vertex(prim->vertices[n],prim->quantization);
+    }
+}
+
+static void decode_vertices(const Primitive* prim,vector<Vertex>& vertices)
+{
+    vertices.resize(prim->packed.size());
+
+    for (size_t n=0;n<prim->packed.size();n++) {
+        vertices[n] = decode_vertex(prim->packed[n],prim->quantization);
+    }
+}
+
+void decode_primitive(Primitive* prim)
+{
+    decode_vertices(prim,prim->vertices);
+}
+
+const vector<Vertex>& primitive_vertices(const Primitive* prim,vector<Vertex>& decoded)
+{
+    if (!prim->vertices.empty() or prim->packed.empty()) {
+        return prim->vertices;
+    }
+
+    decode_vertices(prim,decoded);
+
+    return decoded;
+}
+
+size_t vbo_bytes(const vector<Primitive*>& primitives,size_t vertex_size)
+{
+    size_t vertices = 0;
+
+    for (const Primitive* prim : primitives) {
+        // meshlets split the same indices the whole vbo would hold
+        vertices+=prim->index_count;
+
+        for (const Lod& lod : prim->lods) {
+            vertices+=lod.index_count;
+        }
+    }
+
+    return vertices*vertex_size;
+}
+
+size_t vertex_bytes(const vector<Primitive*>& primitives,size_t vertex_size)
+{
+    size_t vertices = 0;
+
+    for (const Primitive* prim : primitives) {
+        vertices+=prim->vertex_count;
+    }
+
+    return vertices*vertex_size;
+}
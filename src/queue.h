@@ -0,0 +1,76 @@
+#ifndef DEMO_QUEUE_H
+#define DEMO_QUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <cstddef>
+
+/*
+    Bounded lock-free queue for exactly one producer and one consumer
+    thread. Each side owns one index and only reads the other one, the
+    release store of an index publishes the slots written before it.
+    Capacity is rounded up to a power of two.
+*/
+template <typename T>
+struct SpscQueue
+{
+    std::vector<T> slots;
+    size_t mask;
+
+    // kept on separate cache lines, each is written by one thread only
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+
+    explicit SpscQueue(size_t capacity) : head(0), tail(0)
+    {
+        size_t size = 1;
+
+        while (size<capacity) {
+            size<<=1;
+        }
+
+        slots.resize(size);
+        mask = size-1;
+    }
+
+    // producer side, false when full
+    bool try_push(const T& value)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+
+        if (t-head.load(std::memory_order_acquire)>mask) {
+            return false;
+        }
+
+        slots[t & mask] = value;
+        tail.store(t+1,std::memory_order_release);
+
+        return true;
+    }
+
+    // producer side, yields while the consumer catches up
+    void push(const T& value)
+    {
+        while (!try_push(value)) {
+            std::this_thread::yield();
+        }
+    }
+
+    // consumer side, false when empty
+    bool try_pop(T& value)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+
+        if (h==tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = slots[h & mask];
+        head.store(h+1,std::memory_order_release);
+
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,288 @@
+#include "render.h"
+#include "cull.h"
+#include "resolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+View make_view(const glm::mat4& projection,const glm::mat4& modelview,int height)
+{
+    View view;
+
+    view.mvp = projection * modelview;
+    view.modelview = modelview;
+    view.viewport = glm::mat4(1.0f);
+    view.pixel_scale = 0.5f * height * fabs(projection[1][1]);
+
+    return view;
+}
+
+void set_viewport(View& view,int width,int height,int full_width,int full_height)
+{
+    float scale_x = width/(float)full_width;
+    float scale_y = height/(float)full_height;
+
+    view.viewport = viewport_matrix(scale_x,scale_y);
+    view.pixel_scale*=scale_y;
+}
+
+static float lod_error(const Primitive* prim,int level)
+{
+    return (level==0) ? 0.0f : prim->lods[level-1].error;
+}
+
+/*
+    Moves the current level of an instance. Refining happens as soon as
+    the error goes over the limit, coarsening only once the next level is
+    well under it, so an instance sitting at the threshold does not pop.
+    camera is in object space, like the errors.
+*/
+static int select_lod(const Primitive* prim,Instance& instance,const View& view,const glm::vec3& camera)
+{
+    float distance = glm::length(camera - prim->bounds.center) - prim->bounds.radius;
+
+    if (distance<=0.0f) {
+        instance.lod = 0;
+        return 0;
+    }
+
+    float scale = view.pixel_scale / distance;
+    int level = instance.lod;
+
+    if (lod_error(prim,level)*scale>LOD_PIXEL_ERROR) {
+        while (level>0 and lod_error(prim,level)*scale>LOD_PIXEL_ERROR) {
+            level--;
+        }
+    }
+    else {
+        while (level<(int)prim->lods.size() and lod_error(prim,level+1)*scale<=LOD_PIXEL_ERROR*LOD_HYSTERESIS) {
+            level++;
+        }
+    }
+
+    instance.lod = level;
+
+    return level;
+}
+
+/*
+    Uniforms and texture of the draws queued since the last flush. blaster
+    does not promise that bl_raster_draw keeps the uniforms and texture it
+    was called with, its draw workers may read them when they run the
+    command. Queued draws are flushed before either changes, draws of the
+    same instance share them and are never flushed in between.
+*/
+struct DrawState
+{
+    const Instance* instance = nullptr;
+    bl_texture_t* texture = nullptr;
+
+    bool pending = false;
+};
+
+static void set_draw_state(bl_raster_t* raster,DrawState& state,const Instance* instance,const glm::mat4& clip,const glm::mat4& model,bl_texture_t* texture,DrawStats& stats)
+{
+    if (state.instance==instance and state.texture==texture) {
+        return;
+    }
+
+    if (state.pending) {
+        bl_raster_flush_draw(raster);
+        stats.state_flushes++;
+        state.pending = false;
+    }
+
+    if (state.instance!=instance) {
+        bl_raster_uniform_set_matrix(raster,0 , (bl_matrix_t*)&clip[0][0]);
+        bl_raster_uniform_set_matrix(raster,1 , (bl_matrix_t*)&model[0][0]);
+    }
+
+    if (state.texture!=texture) {
+        bl_raster_set_texture(raster,texture);
+    }
+
+    state.instance = instance;
+    state.texture = texture;
+}
+
+static void submit(bl_raster_t* raster,DrawState& state,bl_vbo_t* vbo,int type,DrawStats& stats)
+{
+    bl_raster_draw(raster,vbo,type);
+
+    state.pending = true;
+    stats.draw_calls++;
+}
+
+// uploaded levels of the primitive texture must exist
+static bl_texture_t* select_mip_texture(const Primitive* prim,const View& view,const glm::vec3& camera,DrawStats& stats)
+{
+    const MipTexture* texture = prim->texture;
+
+    float distance = glm::length(camera - prim->bounds.center) - prim->bounds.radius;
+    int level = 0;
+
+    if (distance>0.0f) {
+        const MipLevel& base = texture->levels[0];
+        float size = max(base.width,base.height);
+
+        // texels over pixels covered by one object space unit
+        level = select_mip_level(*texture,prim->uv_density*size*distance/view.pixel_scale);
+    }
+
+    stats.mip_instances[level]++;
+
+    return texture->bl_levels[level];
+}
+
+static void draw_meshlets(bl_raster_t* raster,DrawState& state,Primitive* prim,const View& view,const glm::mat4& transform,const Frustum& frustum,const glm::vec3& camera,DrawStats& stats)
+{
+    for (Meshlet& meshlet : prim->meshlets) {
+        size_t triangles = meshlet.count/3;
+
+        if (!frustum_test_sphere(frustum,meshlet.center,meshlet.radius)) {
+            stats.meshlets_culled++;
+            stats.triangles_culled+=triangles;
+            continue;
+        }
+
+        if (meshlet_backfacing(meshlet,camera)) {
+            stats.meshlets_backfacing++;
+            stats.triangles_culled+=triangles;
+            continue;
+        }
+
+        glm::vec3 extent(meshlet.radius);
+
+        if (view.hiz and hiz_occluded(*view.hiz,transform,meshlet.center-extent,meshlet.center+extent)) {
+            stats.meshlets_occluded++;
+            stats.triangles_culled+=triangles;
+            continue;
+        }
+
+        submit(raster,state,meshlet.vbo,BL_VBO_TRIANGLES,stats);
+
+        stats.meshlets_drawn++;
+        stats.triangles_drawn+=triangles;
+        stats.vertices_shaded+=meshlet.count;
+        stats.vertex_cache_misses+=meshlet.vertex_count;
+    }
+}
+
+static void draw_wireframe(bl_raster_t* raster,DrawState& state,Primitive* prim,const View& view,DrawStats& stats)
+{
+    if (view.mode==RenderMode::Points) {
+        if (!prim->points_vbo) {
+            prim->points_vbo = build_points_vbo(prim);
+        }
+
+        submit(raster,state,prim->points_vbo,BL_VBO_POINTS,stats);
+
+        stats.points_drawn+=prim->vertex_count;
+        return;
+    }
+
+    bl_vbo_t*& vbo = view.feature_edges ? prim->feature_lines_vbo : prim->lines_vbo;
+
+    if (!vbo) {
+        vbo = build_lines_vbo(prim,view.feature_edges);
+    }
+
+    submit(raster,state,vbo,BL_VBO_LINES,stats);
+
+    stats.lines_drawn+=view.feature_edges ? prim->feature_lines : prim->lines;
+}
+
+// false when the instance is outside the frustum
+static bool draw_instance(bl_raster_t* raster,DrawState& state,Primitive* prim,Instance& instance,const View& view,DrawStats& stats)
+{
+    size_t triangles = prim->index_count/3;
+
+    glm::mat4 mvp = view.mvp * instance.transform;
+    glm::mat4 model = view.modelview * instance.transform;
+
+    Frustum frustum = frustum_from_matrix(mvp);
+
+    if (!frustum_test_aabb(frustum,prim->bounds.min,prim->bounds.max)) {
+        stats.instances_culled++;
+        stats.triangles_culled+=triangles;
+        return false;
+    }
+
+    if (view.hiz and hiz_occluded(*view.hiz,instance.transform,prim->bounds.min,prim->bounds.max)) {
+        stats.instances_occluded++;
+        stats.triangles_culled+=triangles;
+        return false;
+    }
+
+    stats.instances_drawn++;
+
+    glm::vec4 eye = glm::inverse(model) * glm::vec4(0.0f,0.0f,0.0f,1.0f);
+    glm::vec3 camera(eye.x,eye.y,eye.z);
+
+    glm::mat4 clip = view.viewport * mvp;
+
+    bl_texture_t* texture = view.texture ? view.texture : white_texture(raster->color_buffer->type);
+
+    if (prim->texture and !prim->texture->bl_levels.empty()) {
+        texture = select_mip_texture(prim,view,camera,stats);
+    }
+
+    set_draw_state(raster,state,&instance,clip,model,texture,stats);
+
+    if (view.mode!=RenderMode::Triangles) {
+        draw_wireframe(raster,state,prim,view,stats);
+        return true;
+    }
+
+    int level = prim->lods.empty() ? 0 : select_lod(prim,instance,view,camera);
+    stats.lod_primitives[level]++;
+
+    if (level>0) {
+        Lod& lod = prim->lods[level-1];
+        size_t count = lod.index_count/3;
+
+        submit(raster,state,lod.vbo,BL_VBO_TRIANGLES,stats);
+
+        stats.triangles_drawn+=count;
+        stats.triangles_simplified+=triangles-count;
+        stats.vertices_shaded+=lod.index_count;
+        stats.vertex_cache_misses+=lod.cache_misses;
+        return true;
+    }
+
+    if (!prim->meshlets.empty()) {
+        draw_meshlets(raster,state,prim,view,instance.transform,frustum,camera,stats);
+        return true;
+    }
+
+    submit(raster,state,prim->vbo,BL_VBO_TRIANGLES,stats);
+
+    stats.triangles_drawn+=triangles;
+    stats.vertices_shaded+=prim->index_count;
+    stats.vertex_cache_misses+=prim->cache_misses;
+
+    return true;
+}
+
+void draw_primitives(bl_raster_t* raster,const vector<Primitive*>& primitives,const View& view,DrawStats& stats)
+{
+    DrawState state;
+
+    for (Primitive* prim : primitives) {
+        bool drawn = false;
+
+        // instances of a primitive go one after the other, sharing its vbo
+        for (Instance& instance : prim->instances) {
+            drawn|=draw_instance(raster,state,prim,instance,view,stats);
+        }
+
+        if (drawn) {
+            stats.primitives_drawn++;
+        }
+        else {
+            stats.primitives_culled++;
+        }
+    }
+}
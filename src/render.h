@@ -0,0 +1,113 @@
+#ifndef DEMO_RENDER_H
+#define DEMO_RENDER_H
+
+#include "mesh.h"
+#include "texture.h"
+#include "hiz.h"
+
+#include <blaster/raster.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstddef>
+
+enum class RenderMode {
+    Points,
+    Lines,
+    Triangles
+};
+
+// counters accumulated by draw_primitives, callers reset them
+struct DrawStats
+{
+    size_t primitives_drawn = 0;
+    size_t primitives_culled = 0;
+    size_t triangles_drawn = 0;
+    size_t triangles_culled = 0;
+
+    size_t instances_drawn = 0;
+    size_t instances_culled = 0;
+    size_t draw_calls = 0;
+
+    // bl_raster_flush_draw calls made to change uniforms or texture
+    size_t state_flushes = 0;
+
+    size_t meshlets_drawn = 0;
+    size_t meshlets_culled = 0;
+    size_t meshlets_backfacing = 0;
+
+    // behind last frame's depth, counted apart from frustum culling
+    size_t instances_occluded = 0;
+    size_t meshlets_occluded = 0;
+
+    // indices drawn, and the vertex shader runs a VERTEX_CACHE_SIZE fifo
+    // cache would need for them, simulated when the primitive is built
+    size_t vertices_shaded = 0;
+    size_t vertex_cache_misses = 0;
+
+    // instances drawn at each lod level, and triangles spared by them
+    size_t lod_primitives[LOD_MAX_LEVELS+1] = {};
+    size_t triangles_simplified = 0;
+
+    // unique edges and vertices drawn in the lines and points modes
+    size_t lines_drawn = 0;
+    size_t points_drawn = 0;
+
+    // textured instances drawn with each mip level bound
+    size_t mip_instances[MIP_MAX_LEVELS] = {};
+};
+
+// largest lod error allowed on screen, in pixels
+#define LOD_PIXEL_ERROR 1.0f
+
+// a coarser level is only taken once its error drops below this fraction
+#define LOD_HYSTERESIS 0.75f
+
+// camera of a frame
+struct View
+{
+    glm::mat4 mvp;
+    glm::mat4 modelview;
+
+    // applied after mvp, on the uniform only, culling ignores it
+    glm::mat4 viewport;
+
+    // pixels covered by one unit at distance one
+    float pixel_scale;
+
+    // previous frame depth pyramid, no occlusion culling when null
+    const HiZ* hiz = nullptr;
+
+    // bound for primitives without a texture of their own, white when null
+    bl_texture_t* texture = nullptr;
+
+    // lines and points VBOs get built the first time they are needed
+    RenderMode mode = RenderMode::Triangles;
+    bool feature_edges = false;
+};
+
+View make_view(const glm::mat4& projection,const glm::mat4& modelview,int height);
+
+// renders into the top left width x height pixels of a full_width x full_height raster
+void set_viewport(View& view,int width,int height,int full_width,int full_height);
+
+/*
+    Submits every instance whose bounds intersect the view frustum, setting
+    uniforms 0 and 1 to view.mvp and view.modelview times the instance
+    transform, uniform 0 going through view.viewport too. Primitives split into meshlets are culled per meshlet,
+    against the frustum and by facing relative to the camera, found
+    through the inverse of modelview. Primitives with lods are drawn at
+    the coarsest level whose error stays under LOD_PIXEL_ERROR pixels,
+    with a hysteresis band around the switch. With view.hiz, instances and
+    meshlets hidden last frame are skipped. In the lines and points modes
+    instances are drawn as unique edges (feature edges only with
+    view.feature_edges) or unique vertices instead. Textured primitives bind
+    the mip level closest to one texel per pixel at their nearest point,
+    every other draw binds view.texture. Draws already queued are flushed
+    before the uniforms or texture change, the caller still flushes the
+    last ones.
+*/
+void draw_primitives(bl_raster_t* raster,const std::vector<Primitive*>& primitives,const View& view,DrawStats& stats);
+
+#endif
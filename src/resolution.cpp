@@ -0,0 +1,63 @@
+#include "resolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+bool update_resolution(ResolutionController& controller,double frame_us)
+{
+    if (controller.target_us<=0) {
+        return false;
+    }
+
+    controller.sum_us+=frame_us;
+    controller.frames++;
+
+    if (controller.frames<RESOLUTION_PERIOD) {
+        return false;
+    }
+
+    double average = controller.sum_us/controller.frames;
+
+    controller.sum_us = 0;
+    controller.frames = 0;
+
+    double ratio = controller.target_us/average;
+
+    if (ratio>0.95 and ratio<1.05) {
+        return false;
+    }
+
+    // one step at most 10% either way, so a single spike does not halve resolution
+    float step = min(1.1,max(0.9,sqrt(ratio)));
+    float scale = min(controller.max_scale,max(controller.min_scale,controller.scale*step));
+
+    if (scale==controller.scale) {
+        return false;
+    }
+
+    controller.scale = scale;
+
+    return true;
+}
+
+int scaled_size(int size,float scale)
+{
+    int scaled = ((int)(size*scale)) & ~7;
+
+    return max(8,min(size,scaled));
+}
+
+glm::mat4 viewport_matrix(float scale_x,float scale_y)
+{
+    // x' = (x+1)*s-1, keeping the -1 edge of clip space in place
+    glm::mat4 m(1.0f);
+
+    m[0][0] = scale_x;
+    m[1][1] = scale_y;
+    m[3][0] = scale_x-1.0f;
+    m[3][1] = scale_y-1.0f;
+
+    return m;
+}
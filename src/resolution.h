@@ -0,0 +1,40 @@
+#ifndef DEMO_RESOLUTION_H
+#define DEMO_RESOLUTION_H
+
+#include <glm/glm.hpp>
+
+// frames averaged between two scale changes
+#define RESOLUTION_PERIOD 15
+
+/*
+    Dynamic resolution. The frame is rendered into the top left part of the
+    raster, scale times its size on each axis, and stretched to the window
+    on present, so the raster and its workers are never re-created.
+*/
+struct ResolutionController
+{
+    // draw plus update time to hold, zero disables the controller
+    double target_us = 0;
+
+    float min_scale = 0.5f;
+    float max_scale = 1.0f;
+    float scale = 1.0f;
+
+    double sum_us = 0;
+    int frames = 0;
+};
+
+/*
+    Feeds the draw and update time of a frame, returns true when scale
+    changed. Pixel work goes with the square of scale, so the new scale is
+    sqrt(target/measured) times the old one, ignoring errors under 5%.
+*/
+bool update_resolution(ResolutionController& controller,double frame_us);
+
+// scaled size, rounded down to a multiple of 8 pixels and at least 8
+int scaled_size(int size,float scale);
+
+// maps clip space onto the scaled part of the raster
+glm::mat4 viewport_matrix(float scale_x,float scale_y);
+
+#endif
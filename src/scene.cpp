@@ -0,0 +1,215 @@
+#include "scene.h"
+
+#include <glm/ext.hpp>
+
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+
+using namespace std;
+
+// screen half height at the benchmark camera distance, with some margin
+#define SCENE_HALF_HEIGHT 32.0f
+
+static void add_vertex(Primitive* prim,glm::vec3 p,glm::vec3 n,float u,float v)
+{
+    Vertex vertex;
+
+    vertex.p = {p.x,p.y,p.z,1.0f};
+    vertex.n = {n.x,n.y,n.z,0.0f};
+    vertex.t = {u,v};
+
+    prim->vertices.push_back(vertex);
+}
+
+// counter clockwise seen from +z, z fixed
+static void add_quad(Primitive* prim,float x0,float y0,float x1,float y1,float z)
+{
+    uint32_t base = prim->vertices.size();
+    glm::vec3 n(0.0f,0.0f,1.0f);
+
+    add_vertex(prim,glm::vec3(x0,y0,z),n,0.0f,0.0f);
+    add_vertex(prim,glm::vec3(x1,y0,z),n,1.0f,0.0f);
+    add_vertex(prim,glm::vec3(x1,y1,z),n,1.0f,1.0f);
+    add_vertex(prim,glm::vec3(x0,y1,z),n,0.0f,1.0f);
+
+    uint32_t quad[6] = {0,1,2,0,2,3};
+
+    for (uint32_t i : quad) {
+        prim->indices.push_back(base+i);
+    }
+}
+
+// unit sphere with rings latitude bands, 4*rings*(rings-1) triangles
+static Primitive* sphere_primitive(int rings)
+{
+    Primitive* prim = new Primitive();
+    int segments = rings*2;
+
+    for (int i=0;i<=rings;i++) {
+        float theta = i*(float)M_PI/rings;
+
+        for (int j=0;j<=segments;j++) {
+            float phi = j*2.0f*(float)M_PI/segments;
+            glm::vec3 p(sinf(theta)*cosf(phi),cosf(theta),sinf(theta)*sinf(phi));
+
+            add_vertex(prim,p,p,j/(float)segments,i/(float)rings);
+        }
+    }
+
+    for (int i=0;i<rings;i++) {
+        for (int j=0;j<segments;j++) {
+            uint32_t a = i*(segments+1)+j;
+            uint32_t b = a+segments+1;
+            uint32_t c = b+1;
+            uint32_t d = a+1;
+
+            // pole bands only have one non degenerate triangle per segment
+            if (i>0) {
+                prim->indices.insert(prim->indices.end(),{a,d,c});
+            }
+
+            if (i<rings-1) {
+                prim->indices.insert(prim->indices.end(),{a,c,b});
+            }
+        }
+    }
+
+    return prim;
+}
+
+static void sphere_grid(Scene& scene,size_t triangles)
+{
+    // about 2000 triangles per sphere once there are enough of them
+    int grid = max(1,(int)ceil(sqrt(triangles/2000.0)));
+    size_t per_sphere = max((size_t)24,triangles/(grid*grid));
+    int rings = max(3,(int)(sqrt(per_sphere/4.0)+0.5));
+
+    Primitive* prim = sphere_primitive(rings);
+
+    float spacing = 2.0f*SCENE_HALF_HEIGHT/grid;
+
+    for (int y=0;y<grid;y++) {
+        for (int x=0;x<grid;x++) {
+            glm::vec3 center(-SCENE_HALF_HEIGHT + (x+0.5f)*spacing,-SCENE_HALF_HEIGHT + (y+0.5f)*spacing,0.0f);
+
+            Instance instance;
+            instance.transform = glm::translate(glm::mat4(1.0f),center);
+            instance.transform = glm::scale(instance.transform,glm::vec3(spacing*0.45f));
+
+            prim->instances.push_back(instance);
+        }
+    }
+
+    scene.primitives.push_back(prim);
+    scene.triangles = prim->indices.size()/3 * prim->instances.size();
+}
+
+static void overdraw(Scene& scene,int layers)
+{
+    // separate primitives so they are submitted back to front
+    for (int n=0;n<layers;n++) {
+        Primitive* prim = new Primitive();
+
+        add_quad(prim,-2.0f*SCENE_HALF_HEIGHT,-SCENE_HALF_HEIGHT,2.0f*SCENE_HALF_HEIGHT,SCENE_HALF_HEIGHT,n*0.05f);
+        scene.primitives.push_back(prim);
+    }
+
+    scene.triangles = layers*2;
+    scene.depth_complexity = layers;
+}
+
+static void tiny_triangles(Scene& scene,size_t triangles)
+{
+    // 2x2 units, about 36x36 pixels of a 1080p screen
+    int side = max(1,(int)sqrt(triangles/2.0));
+    float step = 2.0f/side;
+
+    Primitive* prim = new Primitive();
+
+    for (int y=0;y<=side;y++) {
+        for (int x=0;x<=side;x++) {
+            add_vertex(prim,glm::vec3(-1.0f+x*step,-1.0f+y*step,0.0f),glm::vec3(0.0f,0.0f,1.0f),x/(float)side,y/(float)side);
+        }
+    }
+
+    for (int y=0;y<side;y++) {
+        for (int x=0;x<side;x++) {
+            uint32_t a = y*(side+1)+x;
+            uint32_t b = a+1;
+            uint32_t c = b+side+1;
+            uint32_t d = a+side+1;
+
+            prim->indices.insert(prim->indices.end(),{a,b,c,a,c,d});
+        }
+    }
+
+    scene.primitives.push_back(prim);
+    scene.triangles = prim->indices.size()/3;
+    scene.depth_complexity = (36.0f*36.0f)/(1920.0f*1080.0f);
+}
+
+static void textured_quad(Scene& scene,int size)
+{
+    vector<uint8_t> rgb(size*size*3);
+    uint32_t seed = 1;
+
+    for (uint8_t& c : rgb) {
+        seed = seed*1664525 + 1013904223;
+        c = seed>>24;
+    }
+
+    MipTexture* texture = new MipTexture();
+    build_mip_chain(*texture,rgb.data(),size,size,3);
+
+    Primitive* prim = new Primitive();
+    add_quad(prim,-2.0f*SCENE_HALF_HEIGHT,-SCENE_HALF_HEIGHT,2.0f*SCENE_HALF_HEIGHT,SCENE_HALF_HEIGHT,0.0f);
+    prim->material_texture = 0;
+
+    scene.primitives.push_back(prim);
+    scene.textures.push_back(texture);
+    scene.triangles = 2;
+}
+
+bool build_scene(const string& name,Scene& scene,const BuildOptions& options)
+{
+    size_t sep = name.find(':');
+    string kind = name.substr(0,sep);
+    long param = (sep==string::npos) ? 0 : atol(name.c_str()+sep+1);
+
+    if (param<=0) {
+        clog<<"Missing scene parameter: "<<name<<endl;
+        return false;
+    }
+
+    if (kind=="spheres") {
+        sphere_grid(scene,param);
+    }
+    else if (kind=="overdraw") {
+        overdraw(scene,param);
+    }
+    else if (kind=="tiny") {
+        tiny_triangles(scene,param);
+    }
+    else if (kind=="textured-quad") {
+        textured_quad(scene,param);
+    }
+    else {
+        clog<<"Unknown scene: "<<name<<endl;
+        return false;
+    }
+
+    for (Primitive* prim : scene.primitives) {
+        finish_primitive(prim,options);
+    }
+
+    for (Primitive* prim : scene.primitives) {
+        if (prim->material_texture>=0 and prim->material_texture<(int)scene.textures.size()) {
+            prim->texture = scene.textures[prim->material_texture];
+        }
+    }
+
+    clog<<"scene "<<name<<": "<<scene.primitives.size()<<" primitives, "<<scene.triangles<<" triangles"<<endl;
+
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef DEMO_SCENE_H
+#define DEMO_SCENE_H
+
+#include "mesh.h"
+#include "texture.h"
+
+#include <string>
+#include <vector>
+
+/*
+    Procedural workload for the benchmarks, framed for a camera 30 units
+    away looking down -z, which sees 30 units up and down from the center
+*/
+struct Scene
+{
+    std::vector<Primitive*> primitives;
+    std::vector<MipTexture*> textures;
+
+    // triangles submitted per frame, instances included
+    size_t triangles = 0;
+
+    // average layers of pixels covering the screen, for pixel rates
+    float depth_complexity = 1.0f;
+};
+
+/*
+    Builds a scene from name:parameter
+      spheres:T         grid of instanced spheres, T triangles in total
+      overdraw:L        L screen filling quads, drawn back to front
+      tiny:T            T sub-pixel triangles in the middle of the screen
+      textured-quad:S   one screen filling quad with an SxS mipmapped texture
+    Textures are not uploaded.
+*/
+bool build_scene(const std::string& name,Scene& scene,const BuildOptions& options);
+
+#endif
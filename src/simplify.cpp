@@ -0,0 +1,343 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+/*
+    Symmetric 4x4 error quadric plus the accumulated weight, so errors can
+    be normalized back to squared distances
+*/
+struct Quadric
+{
+    double a2, ab, ac, ad;
+    double b2, bc, bd;
+    double c2, cd;
+    double d2;
+    double w;
+
+    void clear()
+    {
+        a2 = ab = ac = ad = b2 = bc = bd = c2 = cd = d2 = w = 0.0;
+    }
+
+    void add(const Quadric& q)
+    {
+        a2+=q.a2; ab+=q.ab; ac+=q.ac; ad+=q.ad;
+        b2+=q.b2; bc+=q.bc; bd+=q.bd;
+        c2+=q.c2; cd+=q.cd;
+        d2+=q.d2;
+        w+=q.w;
+    }
+
+    void add_plane(double a,double b,double c,double d,double weight)
+    {
+        a2+=weight*a*a; ab+=weight*a*b; ac+=weight*a*c; ad+=weight*a*d;
+        b2+=weight*b*b; bc+=weight*b*c; bd+=weight*b*d;
+        c2+=weight*c*c; cd+=weight*c*d;
+        d2+=weight*d*d;
+        w+=weight;
+    }
+
+    // mean squared distance of p to the accumulated planes
+    double error(const bl_vector_t& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+
+        double e = a2*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x
+                 + b2*y*y + 2*bc*y*z + 2*bd*y
+                 + c2*z*z + 2*cd*z
+                 + d2;
+
+        return (w>0.0) ? fabs(e)/w : 0.0;
+    }
+};
+
+struct Collapse
+{
+    uint32_t src;
+    uint32_t dst;
+    double cost;
+
+    bool operator<(const Collapse& other) const
+    {
+        return cost<other.cost;
+    }
+};
+
+static inline uint64_t edge_key(uint32_t a,uint32_t b)
+{
+    return (a<b) ? ((uint64_t)a<<32 | b) : ((uint64_t)b<<32 | a);
+}
+
+static glm::vec3 triangle_normal(const bl_vector_t& a,const bl_vector_t& b,const bl_vector_t& c)
+{
+    glm::vec3 pa(a.x,a.y,a.z);
+    glm::vec3 pb(b.x,b.y,b.z);
+    glm::vec3 pc(c.x,c.y,c.z);
+
+    return glm::cross(pb-pa,pc-pa);
+}
+
+/*
+    true when moving src onto dst flips any triangle around src, triangles
+    are seen through the collapses already done in this pass
+*/
+static bool collapse_flips(const vector<Vertex>& vertices,const vector<uint32_t>& indices,const vector<uint32_t>& remap,
+                           const uint32_t* tris,uint32_t count,uint32_t src,uint32_t dst)
+{
+    for (uint32_t n=0;n<count;n++) {
+        const uint32_t* tri = &indices[tris[n]*3];
+        uint32_t v[3] = {remap[tri[0]],remap[tri[1]],remap[tri[2]]};
+
+        if (v[0]==dst or v[1]==dst or v[2]==dst or v[0]==v[1] or v[1]==v[2] or v[0]==v[2]) {
+            // degenerate, it goes away
+            continue;
+        }
+
+        const bl_vector_t* p[3];
+        const bl_vector_t* q[3];
+
+        for (int k=0;k<3;k++) {
+            p[k] = &vertices[v[k]].p;
+            q[k] = (v[k]==src) ? &vertices[dst].p : p[k];
+        }
+
+        glm::vec3 before = triangle_normal(*p[0],*p[1],*p[2]);
+        glm::vec3 after = triangle_normal(*q[0],*q[1],*q[2]);
+
+        if (glm::dot(before,after) <= 0.25f * glm::length(before) * glm::length(after)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+vector<uint32_t> simplify_mesh(const vector<Vertex>& vertices,const vector<uint32_t>& indices,size_t target,float& error)
+{
+    size_t vertex_count = vertices.size();
+    vector<uint32_t> result = indices;
+
+    error = 0.0f;
+
+    vector<Quadric> quadrics(vertex_count);
+
+    for (Quadric& q : quadrics) {
+        q.clear();
+    }
+
+    for (size_t n=0;n<result.size();n+=3) {
+        const bl_vector_t& a = vertices[result[n]].p;
+        const bl_vector_t& b = vertices[result[n+1]].p;
+        const bl_vector_t& c = vertices[result[n+2]].p;
+
+        glm::vec3 normal = triangle_normal(a,b,c);
+        float len = glm::length(normal);
+
+        if (len<=0.0f) {
+            continue;
+        }
+
+        normal = normal/len;
+        double d = -(normal.x*a.x + normal.y*a.y + normal.z*a.z);
+
+        for (int k=0;k<3;k++) {
+            quadrics[result[n+k]].add_plane(normal.x,normal.y,normal.z,d,len*0.5f);
+        }
+    }
+
+    /*
+        Vertices on open borders are locked, uv and normal seams show up as
+        borders too since their vertices are split, so they are kept intact
+    */
+    vector<bool> locked(vertex_count,false);
+    vector<uint64_t> edges;
+    edges.reserve(result.size());
+
+    for (size_t n=0;n<result.size();n+=3) {
+        for (int k=0;k<3;k++) {
+            edges.push_back(edge_key(result[n+k],result[n+(k+1)%3]));
+        }
+    }
+
+    sort(edges.begin(),edges.end());
+
+    for (size_t n=0;n<edges.size();) {
+        size_t m = n+1;
+
+        while (m<edges.size() and edges[m]==edges[n]) {
+            m++;
+        }
+
+        if (m-n==1) {
+            locked[edges[n]>>32] = true;
+            locked[edges[n] & 0xffffffff] = true;
+        }
+
+        n = m;
+    }
+
+    vector<uint32_t> remap(vertex_count);
+    vector<bool> touched(vertex_count);
+    vector<uint32_t> offsets(vertex_count+1);
+    vector<uint32_t> adjacency;
+    vector<Collapse> collapses;
+
+    while (result.size()>target*3) {
+
+        // vertex to triangle adjacency of the current triangles
+        fill(offsets.begin(),offsets.end(),0);
+
+        for (uint32_t v : result) {
+            offsets[v+1]++;
+        }
+
+        for (size_t n=0;n<vertex_count;n++) {
+            offsets[n+1]+=offsets[n];
+        }
+
+        adjacency.resize(result.size());
+        vector<uint32_t> fillp(offsets.begin(),offsets.end()-1);
+
+        for (size_t n=0;n<result.size();n++) {
+            adjacency[fillp[result[n]]++] = n/3;
+        }
+
+        /*
+            Cheapest direction of every edge. Interior edges show up once per
+            direction, the a<b half is enough. The ones seen only as b<a are
+            on borders, with both ends locked.
+        */
+        collapses.clear();
+        edges.clear();
+
+        for (size_t n=0;n<result.size();n+=3) {
+            for (int k=0;k<3;k++) {
+                uint32_t a = result[n+k];
+                uint32_t b = result[n+(k+1)%3];
+
+                if (a<b) {
+                    edges.push_back((uint64_t)a<<32 | b);
+                }
+            }
+        }
+
+        for (uint64_t e : edges) {
+            uint32_t a = e>>32;
+            uint32_t b = e & 0xffffffff;
+
+            Quadric q = quadrics[a];
+            q.add(quadrics[b]);
+
+            Collapse c;
+            c.cost = -1.0;
+
+            if (!locked[a]) {
+                c.src = a;
+                c.dst = b;
+                c.cost = q.error(vertices[b].p);
+            }
+
+            if (!locked[b]) {
+                double cost = q.error(vertices[a].p);
+
+                if (c.cost<0.0 or cost<c.cost) {
+                    c.src = b;
+                    c.dst = a;
+                    c.cost = cost;
+                }
+            }
+
+            if (c.cost>=0.0) {
+                collapses.push_back(c);
+            }
+        }
+
+        /*
+            Every collapse removes about two triangles, so no more than this
+            many can be used in one pass, only those need to be sorted
+        */
+        size_t triangles = result.size()/3;
+        size_t needed = min(collapses.size(),triangles-target);
+
+        nth_element(collapses.begin(),collapses.begin()+needed,collapses.end());
+        collapses.resize(needed);
+        sort(collapses.begin(),collapses.end());
+
+        for (size_t n=0;n<vertex_count;n++) {
+            remap[n] = n;
+        }
+
+        fill(touched.begin(),touched.end(),false);
+
+        size_t removed = 0;
+        size_t done = 0;
+
+        for (const Collapse& c : collapses) {
+            if (touched[c.src] or touched[c.dst]) {
+                continue;
+            }
+
+            const uint32_t* tris = &adjacency[offsets[c.src]];
+            uint32_t count = offsets[c.src+1]-offsets[c.src];
+
+            if (collapse_flips(vertices,result,remap,tris,count,c.src,c.dst)) {
+                continue;
+            }
+
+            for (uint32_t n=0;n<count;n++) {
+                const uint32_t* tri = &result[tris[n]*3];
+                uint32_t a = remap[tri[0]];
+                uint32_t b = remap[tri[1]];
+                uint32_t d = remap[tri[2]];
+
+                if (a!=b and b!=d and a!=d) {
+                    removed+=(a==c.dst or b==c.dst or d==c.dst);
+                }
+            }
+
+            // both ends stay put until next pass, so remap chains are one deep
+            remap[c.src] = c.dst;
+            quadrics[c.dst].add(quadrics[c.src]);
+
+            touched[c.src] = true;
+            touched[c.dst] = true;
+
+            float e = sqrtf(c.cost);
+
+            if (e>error) {
+                error = e;
+            }
+
+            done++;
+
+            if (triangles-removed<=target) {
+                break;
+            }
+        }
+
+        if (done==0) {
+            break;
+        }
+
+        size_t out = 0;
+
+        for (size_t n=0;n<result.size();n+=3) {
+            uint32_t a = remap[result[n]];
+            uint32_t b = remap[result[n+1]];
+            uint32_t c = remap[result[n+2]];
+
+            if (a!=b and b!=c and a!=c) {
+                result[out++] = a;
+                result[out++] = b;
+                result[out++] = c;
+            }
+        }
+
+        result.resize(out);
+    }
+
+    return result;
+}
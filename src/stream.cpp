@@ -0,0 +1,63 @@
+#include "stream.h"
+
+#include <iostream>
+
+using namespace std;
+
+static void load_thread(StreamLoader* loader,string filename,BuildOptions options,bool with_textures)
+{
+    loader->ok = load_primitives(filename.c_str(),loader->primitives,options,with_textures ? &loader->textures : nullptr,[loader](Primitive* prim) {
+        loader->queue.push(prim);
+    });
+
+    loader->loaded.store(true,std::memory_order_release);
+}
+
+void start_stream(StreamLoader& loader,const char* filename,const BuildOptions& options,bool with_textures)
+{
+    loader.start = std::chrono::steady_clock::now();
+    loader.thread = thread(load_thread,&loader,string(filename),options,with_textures);
+}
+
+size_t poll_stream(StreamLoader& loader,vector<Primitive*>& primitives)
+{
+    size_t count = 0;
+    Primitive* prim;
+
+    while (loader.queue.try_pop(prim)) {
+        primitives.push_back(prim);
+        count++;
+    }
+
+    return count;
+}
+
+bool stream_finished(StreamLoader& loader,vector<Primitive*>& primitives)
+{
+    if (loader.joined) {
+        return true;
+    }
+
+    if (!loader.loaded.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    // pushes happen before the flag is set, this gets the last of them
+    poll_stream(loader,primitives);
+
+    loader.thread.join();
+    loader.joined = true;
+
+    auto t1 = std::chrono::steady_clock::now();
+    clog<<"loaded in background: "<<primitives.size()<<" primitives in "<<std::chrono::duration_cast<std::chrono::milliseconds>(t1-loader.start).count()<<" ms"<<endl;
+
+    return true;
+}
+
+void wait_stream(StreamLoader& loader,vector<Primitive*>& primitives)
+{
+    while (!stream_finished(loader,primitives)) {
+        poll_stream(loader,primitives);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef DEMO_STREAM_H
+#define DEMO_STREAM_H
+
+#include "loader.h"
+#include "queue.h"
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+// primitives in flight between the loading thread and the render loop
+#define STREAM_QUEUE_SIZE 1024
+
+/*
+    Model loaded by a background thread through load_primitives. Every
+    primitive is handed to the render loop through a lock-free queue as
+    soon as it is set up. The loaded flag is set once the thread is done
+    with everything else, textures included.
+*/
+struct StreamLoader
+{
+    std::thread thread;
+    SpscQueue<Primitive*> queue;
+
+    std::atomic<bool> loaded;
+    bool ok = false;
+    bool joined = false;
+
+    // only read once the thread has been joined
+    std::vector<Primitive*> primitives;
+    std::vector<MipTexture*> textures;
+
+    std::chrono::steady_clock::time_point start;
+
+    StreamLoader() : queue(STREAM_QUEUE_SIZE), loaded(false)
+    {
+    }
+};
+
+// starts loading filename, textures are built unless with_textures is false
+void start_stream(StreamLoader& loader,const char* filename,const BuildOptions& options,bool with_textures);
+
+// appends primitives finished since the last call, returns how many
+size_t poll_stream(StreamLoader& loader,std::vector<Primitive*>& primitives);
+
+/*
+    True once every primitive went through poll_stream and the thread has
+    been joined, loader.ok and loader.textures are valid from then on
+*/
+bool stream_finished(StreamLoader& loader,std::vector<Primitive*>& primitives);
+
+// blocks until the model is fully loaded, polling into primitives
+void wait_stream(StreamLoader& loader,std::vector<Primitive*>& primitives);
+
+#endif
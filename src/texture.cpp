@@ -0,0 +1,196 @@
+#include "texture.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+using namespace std;
+
+static uint32_t argb(const uint8_t* p,int components)
+{
+    uint32_t r,g,b,a = 255;
+
+    if (components<3) {
+        r = g = b = p[0];
+
+        if (components==2) {
+            a = p[1];
+        }
+    }
+    else {
+        r = p[0];
+        g = p[1];
+        b = p[2];
+
+        if (components==4) {
+            a = p[3];
+        }
+    }
+
+    return (a<<24) | (r<<16) | (g<<8) | b;
+}
+
+static MipLevel downsample(const MipLevel& src)
+{
+    MipLevel dst;
+
+    dst.width = max(1,src.width/2);
+    dst.height = max(1,src.height/2);
+    dst.pixels.resize(dst.width*dst.height);
+
+    for (int y=0;y<dst.height;y++) {
+        // the odd last row or column of src goes into the last texel
+        int y0 = min(y*2,src.height-1);
+        int y1 = (y==dst.height-1) ? src.height-1 : min(y*2+1,src.height-1);
+
+        for (int x=0;x<dst.width;x++) {
+            int x0 = min(x*2,src.width-1);
+            int x1 = (x==dst.width-1) ? src.width-1 : min(x*2+1,src.width-1);
+
+            uint32_t sum[4] = {0,0,0,0};
+            uint32_t count = 0;
+
+            for (int sy=y0;sy<=y1;sy++) {
+                for (int sx=x0;sx<=x1;sx++) {
+                    uint32_t p = src.pixels[sy*src.width+sx];
+
+                    for (int c=0;c<4;c++) {
+                        sum[c]+=(p>>(c*8)) & 0xff;
+                    }
+
+                    count++;
+                }
+            }
+
+            uint32_t p = 0;
+
+            for (int c=0;c<4;c++) {
+                p|=((sum[c]+count/2)/count)<<(c*8);
+            }
+
+            dst.pixels[y*dst.width+x] = p;
+        }
+    }
+
+    return dst;
+}
+
+void build_mip_chain(MipTexture& texture,const uint8_t* data,int width,int height,int components)
+{
+    texture.levels.clear();
+
+    MipLevel level;
+    level.width = width;
+    level.height = height;
+    level.pixels.resize(width*height);
+
+    for (int n=0;n<width*height;n++) {
+        level.pixels[n] = argb(data+n*components,components);
+    }
+
+    texture.levels.push_back(level);
+
+    while (texture.levels.size()<MIP_MAX_LEVELS and
+           (texture.levels.back().width>1 or texture.levels.back().height>1)) {
+        texture.levels.push_back(downsample(texture.levels.back()));
+    }
+}
+
+void upload_texture(MipTexture& texture,int type)
+{
+    for (MipLevel& level : texture.levels) {
+        bl_texture_t* tx = bl_texture_new(level.width,level.height,type);
+        memcpy(tx->data,level.pixels.data(),level.pixels.size()*sizeof(uint32_t));
+
+        texture.bl_levels.push_back(tx);
+
+        vector<uint32_t>().swap(level.pixels);
+    }
+}
+
+void delete_texture(MipTexture* texture)
+{
+    for (bl_texture_t* tx : texture->bl_levels) {
+        bl_texture_delete(tx);
+    }
+
+    delete texture;
+}
+
+bl_texture_t* white_texture(int type)
+{
+    static bl_texture_t* white = nullptr;
+
+    if (!white) {
+        white = bl_texture_new(1,1,type);
+        *(uint32_t*)white->data = 0xffffffff;
+    }
+
+    return white;
+}
+
+size_t texture_bytes(const vector<MipTexture*>& textures)
+{
+    size_t bytes = 0;
+
+    for (const MipTexture* texture : textures) {
+        if (!texture) {
+            continue;
+        }
+
+        for (const MipLevel& level : texture->levels) {
+            if (!texture->bl_levels.empty()) {
+                bytes+=level.width*(size_t)level.height*sizeof(uint32_t);
+            }
+            else {
+                bytes+=level.pixels.size()*sizeof(uint32_t);
+            }
+        }
+    }
+
+    return bytes;
+}
+
+int select_mip_level(const MipTexture& texture,float texels_per_pixel)
+{
+    if (texels_per_pixel<=1.0f or texture.levels.empty()) {
+        return 0;
+    }
+
+    int level = (int)floorf(log2f(texels_per_pixel) + 0.5f);
+
+    return min(level,(int)texture.levels.size()-1);
+}
+
+static uint32_t spread_bits(uint32_t v)
+{
+    v&=0xffff;
+    v = (v | (v<<8)) & 0x00ff00ff;
+    v = (v | (v<<4)) & 0x0f0f0f0f;
+    v = (v | (v<<2)) & 0x33333333;
+    v = (v | (v<<1)) & 0x55555555;
+
+    return v;
+}
+
+uint32_t morton_code(uint32_t x,uint32_t y)
+{
+    return spread_bits(x) | (spread_bits(y)<<1);
+}
+
+void morton_level(const MipLevel& level,vector<uint32_t>& out)
+{
+    uint32_t side = 1;
+
+    while (side<(uint32_t)level.width or side<(uint32_t)level.height) {
+        side<<=1;
+    }
+
+    out.assign(side*side,0);
+
+    for (int y=0;y<level.height;y++) {
+        for (int x=0;x<level.width;x++) {
+            out[morton_code(x,y)] = level.pixels[y*level.width+x];
+        }
+    }
+}
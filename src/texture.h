@@ -0,0 +1,68 @@
+#ifndef DEMO_TEXTURE_H
+#define DEMO_TEXTURE_H
+
+#include <blaster/texture.h>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// levels kept per texture, enough for 32768 texels wide images
+#define MIP_MAX_LEVELS 16
+
+// ARGB8888 pixels, the layout of the raster color buffer
+struct MipLevel
+{
+    int width;
+    int height;
+
+    std::vector<uint32_t> pixels;
+};
+
+/*
+    Image of a glTF texture with its box filtered mip chain. Levels are
+    copied into blaster textures by upload_texture, draws bind the one
+    matching their on screen texel density.
+*/
+struct MipTexture
+{
+    std::vector<MipLevel> levels;
+
+    // one per level, empty until uploaded
+    std::vector<bl_texture_t*> bl_levels;
+};
+
+/*
+    Builds the chain from 8 bit pixels with 1 to 4 components (gray, gray
+    alpha, rgb, rgba) down to 1x1. Odd sizes round down, the last row or
+    column folds into the previous one.
+*/
+void build_mip_chain(MipTexture& texture,const uint8_t* data,int width,int height,int components);
+
+/*
+    Creates the blaster textures of every level, type as the color buffer
+    one. Level pixels are freed once copied, sizes are kept.
+*/
+void upload_texture(MipTexture& texture,int type);
+
+void delete_texture(MipTexture* texture);
+
+// 1x1 opaque white, made on first use and kept for the whole run
+bl_texture_t* white_texture(int type);
+
+// bytes held by the textures, uploaded levels or pixels otherwise
+size_t texture_bytes(const std::vector<MipTexture*>& textures);
+
+// level whose texels map closest to one pixel, 0 when magnified
+int select_mip_level(const MipTexture& texture,float texels_per_pixel);
+
+// interleaves the bits of x and y, x in the even bits
+uint32_t morton_code(uint32_t x,uint32_t y);
+
+/*
+    Stores a level in Z order, padded to a power of two square, so texels
+    close in both directions are close in memory
+*/
+void morton_level(const MipLevel& level,std::vector<uint32_t>& out);
+
+#endif
@@ -0,0 +1,206 @@
+
+#include "loader.h"
+#include "texture.h"
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+
+using namespace std;
+
+struct TextureBenchOptions
+{
+    const char* filename = nullptr;
+    int size = 2048;
+    int screen = 512;
+    int iterations = 50;
+};
+
+void usage()
+{
+    cerr<<"usage: blaster-texture-bench [options] [model.gltf|model.glb]"<<endl;
+    cerr<<"  --size N          procedural texture size when no model is given (2048)"<<endl;
+    cerr<<"  --screen N        sampled pixels per side (512)"<<endl;
+    cerr<<"  --iterations N    passes per zoom level (50)"<<endl;
+}
+
+bool parse_options(TextureBenchOptions& options,int argc,char* argv[])
+{
+    for (int n=1;n<argc;n++) {
+        string arg = argv[n];
+        bool has_value = (n+1)<argc;
+
+        if (arg=="--size" and has_value) {
+            options.size = atoi(argv[++n]);
+        }
+        else if (arg=="--screen" and has_value) {
+            options.screen = atoi(argv[++n]);
+        }
+        else if (arg=="--iterations" and has_value) {
+            options.iterations = atoi(argv[++n]);
+        }
+        else if (arg[0]!='-' and options.filename==nullptr) {
+            options.filename = argv[n];
+        }
+        else {
+            return false;
+        }
+    }
+
+    return options.size>0 and options.screen>0 and options.iterations>0;
+}
+
+// rgb noise, so every texel differs from its neighbours
+MipTexture* procedural_texture(int size)
+{
+    vector<uint8_t> rgb(size*size*3);
+    uint32_t seed = 1;
+
+    for (uint8_t& c : rgb) {
+        seed = seed*1664525 + 1013904223;
+        c = seed>>24;
+    }
+
+    MipTexture* texture = new MipTexture();
+    build_mip_chain(*texture,rgb.data(),size,size,3);
+
+    return texture;
+}
+
+/*
+    Nearest sampling of a rotated screen sized quad covering zoom texels
+    per pixel, the access pattern of a minified textured surface
+*/
+template <typename Fetch>
+uint32_t sample_quad(int screen,float zoom,int width,int height,Fetch fetch)
+{
+    const float c = cosf(0.3f);
+    const float s = sinf(0.3f);
+
+    uint32_t sum = 0;
+
+    for (int y=0;y<screen;y++) {
+        for (int x=0;x<screen;x++) {
+            int tx = (int)((c*x - s*y) * zoom) + width*64;
+            int ty = (int)((s*x + c*y) * zoom) + height*64;
+
+            sum+=fetch(tx%width,ty%height);
+        }
+    }
+
+    return sum;
+}
+
+double measure(const char* name,int iterations,int screen,uint32_t& checksum,const std::function<uint32_t()>& pass)
+{
+    auto t0 = std::chrono::steady_clock::now();
+
+    for (int i=0;i<iterations;i++) {
+        checksum+=pass();
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    double us = std::chrono::duration_cast<std::chrono::microseconds>(t1-t0).count();
+    double rate = screen*(double)screen*iterations/us;
+
+    printf("  %-12s %8.1f Msamples/s\n",name,rate);
+
+    return rate;
+}
+
+int main(int argc,char* argv[])
+{
+    TextureBenchOptions options;
+
+    if (!parse_options(options,argc,argv)) {
+        usage();
+        return -1;
+    }
+
+    MipTexture* texture = nullptr;
+
+    if (options.filename) {
+        GltfAsset asset;
+
+        if (!load_gltf(asset,options.filename)) {
+            cerr<<"Failed to load "<<options.filename<<endl;
+            return -1;
+        }
+
+        vector<MipTexture*> textures = build_textures(asset);
+
+        // the largest texture of the model
+        for (MipTexture* t : textures) {
+            if (t and (!texture or t->levels[0].pixels.size()>texture->levels[0].pixels.size())) {
+                texture = t;
+            }
+        }
+
+        for (MipTexture* t : textures) {
+            if (t and t!=texture) {
+                delete_texture(t);
+            }
+        }
+
+        if (!texture) {
+            cerr<<"No decodable texture in "<<options.filename<<endl;
+            return -1;
+        }
+    }
+    else {
+        texture = procedural_texture(options.size);
+    }
+
+    const MipLevel& base = texture->levels[0];
+
+    clog<<"texture: "<<base.width<<"x"<<base.height<<", "<<texture->levels.size()<<" levels"<<endl;
+
+    vector<vector<uint32_t> > morton(texture->levels.size());
+
+    for (size_t n=0;n<texture->levels.size();n++) {
+        morton_level(texture->levels[n],morton[n]);
+    }
+
+    uint32_t checksum = 0;
+
+    for (float zoom=1.0f;zoom<=16.0f;zoom*=2.0f) {
+        int level = select_mip_level(*texture,zoom);
+        const MipLevel& mip = texture->levels[level];
+        const vector<uint32_t>& z = morton[level];
+        float mip_zoom = zoom*mip.width/base.width;
+
+        printf("zoom %g texels/pixel, level %d (%dx%d)\n",zoom,level,mip.width,mip.height);
+
+        double before = measure("linear",options.iterations,options.screen,checksum,[&]() -> uint32_t {
+            return sample_quad(options.screen,zoom,base.width,base.height,[&](int x,int y) -> uint32_t {
+                return base.pixels[y*base.width+x];
+            });
+        });
+
+        double mip_rate = measure("mip",options.iterations,options.screen,checksum,[&]() -> uint32_t {
+            return sample_quad(options.screen,mip_zoom,mip.width,mip.height,[&](int x,int y) -> uint32_t {
+                return mip.pixels[y*mip.width+x];
+            });
+        });
+
+        double morton_rate = measure("mip+morton",options.iterations,options.screen,checksum,[&]() -> uint32_t {
+            return sample_quad(options.screen,mip_zoom,mip.width,mip.height,[&](int x,int y) -> uint32_t {
+                return z[morton_code(x,y)];
+            });
+        });
+
+        printf("  mip %.2fx, mip+morton %.2fx linear\n",mip_rate/before,morton_rate/before);
+    }
+
+    clog<<"checksum: "<<checksum<<endl;
+
+    delete_texture(texture);
+
+    return 0;
+}
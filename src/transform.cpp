@@ -0,0 +1,176 @@
+#include "transform.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// storage gets 8 spare floats so the first array can start 32 byte aligned
+static float* aligned(vector<float>& storage)
+{
+    uintptr_t p = (uintptr_t)storage.data();
+    return (float*)((p+31) & ~(uintptr_t)31);
+}
+
+static const float* aligned(const vector<float>& storage)
+{
+    uintptr_t p = (uintptr_t)storage.data();
+    return (const float*)((p+31) & ~(uintptr_t)31);
+}
+
+static size_t padded(size_t count)
+{
+    return (count+7) & ~(size_t)7;
+}
+
+float* SoaVertices::array(int a)
+{
+    return aligned(storage) + a*stride;
+}
+
+const float* SoaVertices::array(int a) const
+{
+    return aligned(storage) + a*stride;
+}
+
+float* ClipVertices::x()
+{
+    return aligned(storage);
+}
+
+float* ClipVertices::y()
+{
+    return aligned(storage) + stride;
+}
+
+float* ClipVertices::z()
+{
+    return aligned(storage) + 2*stride;
+}
+
+float* ClipVertices::w()
+{
+    return aligned(storage) + 3*stride;
+}
+
+void resize_soa_vertices(SoaVertices& soa,size_t count)
+{
+    soa.count = count;
+    soa.stride = padded(count);
+    soa.storage.assign(soa.stride*SoaVertices::ARRAYS + 8,0.0f);
+}
+
+void resize_clip_vertices(ClipVertices& clip,size_t count)
+{
+    clip.count = count;
+    clip.stride = padded(count);
+    clip.storage.assign(clip.stride*4 + 8,0.0f);
+}
+
+void transform_scalar(const glm::mat4& mvp,const SoaVertices& soa,ClipVertices& clip)
+{
+    const float* x = soa.array(SoaVertices::X);
+    const float* y = soa.array(SoaVertices::Y);
+    const float* z = soa.array(SoaVertices::Z);
+
+    float* cx = clip.x();
+    float* cy = clip.y();
+    float* cz = clip.z();
+    float* cw = clip.w();
+
+    for (size_t n=0;n<soa.stride;n++) {
+        cx[n] = mvp[0][0]*x[n] + mvp[1][0]*y[n] + mvp[2][0]*z[n] + mvp[3][0];
+        cy[n] = mvp[0][1]*x[n] + mvp[1][1]*y[n] + mvp[2][1]*z[n] + mvp[3][1];
+        cz[n] = mvp[0][2]*x[n] + mvp[1][2]*y[n] + mvp[2][2]*z[n] + mvp[3][2];
+        cw[n] = mvp[0][3]*x[n] + mvp[1][3]*y[n] + mvp[2][3]*z[n] + mvp[3][3];
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+void transform_sse(const glm::mat4& mvp,const SoaVertices& soa,ClipVertices& clip)
+{
+    const float* x = soa.array(SoaVertices::X);
+    const float* y = soa.array(SoaVertices::Y);
+    const float* z = soa.array(SoaVertices::Z);
+
+    float* out[4] = {clip.x(),clip.y(),clip.z(),clip.w()};
+
+    __m128 m[4][4];
+
+    for (int c=0;c<4;c++) {
+        for (int r=0;r<4;r++) {
+            m[c][r] = _mm_set1_ps(mvp[c][r]);
+        }
+    }
+
+    // two halves of 4 make up each block of 8
+    for (size_t n=0;n<soa.stride;n+=4) {
+        __m128 vx = _mm_load_ps(x+n);
+        __m128 vy = _mm_load_ps(y+n);
+        __m128 vz = _mm_load_ps(z+n);
+
+        for (int r=0;r<4;r++) {
+            __m128 v = _mm_add_ps(_mm_mul_ps(m[0][r],vx),m[3][r]);
+            v = _mm_add_ps(v,_mm_mul_ps(m[1][r],vy));
+            v = _mm_add_ps(v,_mm_mul_ps(m[2][r],vz));
+
+            _mm_store_ps(out[r]+n,v);
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void transform_avx2(const glm::mat4& mvp,const SoaVertices& soa,ClipVertices& clip)
+{
+    const float* x = soa.array(SoaVertices::X);
+    const float* y = soa.array(SoaVertices::Y);
+    const float* z = soa.array(SoaVertices::Z);
+
+    float* out[4] = {clip.x(),clip.y(),clip.z(),clip.w()};
+
+    __m256 m[4][4];
+
+    for (int c=0;c<4;c++) {
+        for (int r=0;r<4;r++) {
+            m[c][r] = _mm256_set1_ps(mvp[c][r]);
+        }
+    }
+
+    for (size_t n=0;n<soa.stride;n+=8) {
+        __m256 vx = _mm256_load_ps(x+n);
+        __m256 vy = _mm256_load_ps(y+n);
+        __m256 vz = _mm256_load_ps(z+n);
+
+        for (int r=0;r<4;r++) {
+            __m256 v = _mm256_fmadd_ps(m[0][r],vx,m[3][r]);
+            v = _mm256_fmadd_ps(m[1][r],vy,v);
+            v = _mm256_fmadd_ps(m[2][r],vz,v);
+
+            _mm256_store_ps(out[r]+n,v);
+        }
+    }
+}
+
+#endif
+
+TransformKernel select_transform_kernel(const char** name)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma")) {
+        *name = "avx2";
+        return transform_avx2;
+    }
+
+    if (__builtin_cpu_supports("sse2")) {
+        *name = "sse";
+        return transform_sse;
+    }
+#endif
+
+    *name = "scalar";
+    return transform_scalar;
+}
@@ -0,0 +1,64 @@
+#ifndef DEMO_TRANSFORM_H
+#define DEMO_TRANSFORM_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+    Structure of arrays copy of a primitive's unique vertices. Every array
+    starts 32 byte aligned and is padded to a multiple of 8 vertices, so
+    kernels never need a scalar tail.
+*/
+struct SoaVertices
+{
+    enum Array {
+        X, Y, Z,
+        NX, NY, NZ,
+        U, V,
+        ARRAYS
+    };
+
+    size_t count = 0;
+    size_t stride = 0;
+
+    std::vector<float> storage;
+
+    float* array(int a);
+    const float* array(int a) const;
+};
+
+// clip space positions in structure of arrays form, padded like SoaVertices
+struct ClipVertices
+{
+    size_t count = 0;
+    size_t stride = 0;
+
+    std::vector<float> storage;
+
+    float* x();
+    float* y();
+    float* z();
+    float* w();
+};
+
+// zero filled, padding included
+void resize_soa_vertices(SoaVertices& soa,size_t count);
+void resize_clip_vertices(ClipVertices& clip,size_t count);
+
+// transforms soa positions (w = 1) by mvp, 8 vertices per iteration
+typedef void (*TransformKernel)(const glm::mat4& mvp,const SoaVertices& soa,ClipVertices& clip);
+
+void transform_scalar(const glm::mat4& mvp,const SoaVertices& soa,ClipVertices& clip);
+
+#if defined(__x86_64__) || defined(__i386__)
+void transform_sse(const glm::mat4& mvp,const SoaVertices& soa,ClipVertices& clip);
+void transform_avx2(const glm::mat4& mvp,const SoaVertices& soa,ClipVertices& clip);
+#endif
+
+// fastest kernel the cpu supports, name gets its name
+TransformKernel select_transform_kernel(const char** name);
+
+#endif
@@ -0,0 +1,225 @@
+
+#include <blaster/vector.h>
+
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#include "loader.h"
+#include "transform.h"
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+
+using namespace std;
+
+struct TransformBenchOptions
+{
+    const char* filename = nullptr;
+    int vertices = 1000000;
+    int iterations = 200;
+};
+
+void usage()
+{
+    cerr<<"usage: blaster-transform-bench [options] [model.gltf|model.glb|model.obj]"<<endl;
+    cerr<<"  --vertices N      procedural vertices when no model is given (1000000)"<<endl;
+    cerr<<"  --iterations N    transforms per kernel (200)"<<endl;
+}
+
+bool parse_options(TransformBenchOptions& options,int argc,char* argv[])
+{
+    for (int n=1;n<argc;n++) {
+        string arg = argv[n];
+        bool has_value = (n+1)<argc;
+
+        if (arg=="--vertices" and has_value) {
+            options.vertices = atoi(argv[++n]);
+        }
+        else if (arg=="--iterations" and has_value) {
+            options.iterations = atoi(argv[++n]);
+        }
+        else if (arg[0]!='-' and options.filename==nullptr) {
+            options.filename = argv[n];
+        }
+        else {
+            return false;
+        }
+    }
+
+    return options.vertices>0 and options.iterations>0;
+}
+
+// points on a unit sphere, normals pointing out
+vector<Vertex> sphere_vertices(size_t count)
+{
+    vector<Vertex> vertices(count);
+
+    for (size_t n=0;n<count;n++) {
+        float z = 1.0f - 2.0f*(n+0.5f)/count;
+        float r = sqrtf(1.0f - z*z);
+        float a = n * 2.399963f;
+
+        Vertex& vertex = vertices[n];
+
+        vertex.p = {r*cosf(a),r*sinf(a),z,1.0f};
+        vertex.n = vertex.p;
+        vertex.n.w = 0.0f;
+        vertex.t = {a/(2.0f*(float)M_PI),z*0.5f+0.5f};
+    }
+
+    return vertices;
+}
+
+/*
+    Reference for the interleaved layout: one 4x4 matrix by vector product
+    per Vertex, as done when walking a 4,4,2 VBO
+*/
+void transform_aos(const glm::mat4& mvp,const vector<Vertex>& vertices,vector<bl_vector_t>& out)
+{
+    for (size_t n=0;n<vertices.size();n++) {
+        const bl_vector_t& p = vertices[n].p;
+        glm::vec4 c = mvp * glm::vec4(p.x,p.y,p.z,p.w);
+
+        out[n] = {c.x,c.y,c.z,c.w};
+    }
+}
+
+// mvp changes every iteration so nothing gets hoisted out of the loop
+glm::mat4 iteration_mvp(int iteration)
+{
+    glm::mat4 projection = glm::frustum(-1.0f,1.0f,1.0f,-1.0f,1.0f,1000.0f);
+    glm::mat4 model(1.0f);
+
+    model = glm::translate(model,glm::vec3(0.0f,0.0f,-30.0f));
+    model = glm::rotate(model,iteration*0.01f,glm::vec3(0.0f,1.0f,0.0f));
+
+    return projection * model;
+}
+
+double report(const char* name,double us,size_t vertices,int iterations)
+{
+    double rate = vertices*(double)iterations/(us/1000000.0);
+
+    printf("%-8s %10.1f us/iteration %8.1f Mvertices/s\n",name,us/iterations,rate/1000000.0);
+
+    return rate;
+}
+
+// largest difference between a kernel and the scalar soa result
+float compare(ClipVertices& a,ClipVertices& b)
+{
+    float* pa[4] = {a.x(),a.y(),a.z(),a.w()};
+    float* pb[4] = {b.x(),b.y(),b.z(),b.w()};
+    float diff = 0.0f;
+
+    for (int c=0;c<4;c++) {
+        for (size_t n=0;n<a.count;n++) {
+            diff = max(diff,fabsf(pa[c][n]-pb[c][n]));
+        }
+    }
+
+    return diff;
+}
+
+int main(int argc,char* argv[])
+{
+    TransformBenchOptions options;
+
+    if (!parse_options(options,argc,argv)) {
+        usage();
+        return -1;
+    }
+
+    vector<Vertex> vertices;
+
+    if (options.filename) {
+        vector<Primitive*> primitives;
+        BuildOptions build;
+
+        if (!load_primitives(options.filename,primitives,build)) {
+            cerr<<"Failed to load "<<options.filename<<endl;
+            return -1;
+        }
+
+        for (Primitive* prim : primitives) {
+            vertices.insert(vertices.end(),prim->vertices.begin(),prim->vertices.end());
+            delete prim;
+        }
+    }
+    else {
+        vertices = sphere_vertices(options.vertices);
+    }
+
+    clog<<"vertices: "<<vertices.size()<<endl;
+
+    SoaVertices soa;
+    build_soa_vertices(vertices,soa);
+
+    vector<bl_vector_t> aos_out(vertices.size());
+    ClipVertices reference;
+    resize_clip_vertices(reference,vertices.size());
+
+    struct Kernel {
+        const char* name;
+        TransformKernel kernel;
+    };
+
+    vector<Kernel> kernels;
+    kernels.push_back({"scalar",transform_scalar});
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse2")) {
+        kernels.push_back({"sse",transform_sse});
+    }
+
+    if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma")) {
+        kernels.push_back({"avx2",transform_avx2});
+    }
+#endif
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    for (int i=0;i<options.iterations;i++) {
+        transform_aos(iteration_mvp(i),vertices,aos_out);
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    double aos_us = std::chrono::duration_cast<std::chrono::microseconds>(t1-t0).count();
+    double aos_rate = report("aos",aos_us,vertices.size(),options.iterations);
+
+    transform_scalar(iteration_mvp(0),soa,reference);
+
+    for (Kernel& k : kernels) {
+        ClipVertices clip;
+        resize_clip_vertices(clip,vertices.size());
+
+        t0 = std::chrono::steady_clock::now();
+
+        for (int i=0;i<options.iterations;i++) {
+            k.kernel(iteration_mvp(i),soa,clip);
+        }
+
+        t1 = std::chrono::steady_clock::now();
+
+        double us = std::chrono::duration_cast<std::chrono::microseconds>(t1-t0).count();
+        double rate = report(k.name,us,vertices.size(),options.iterations);
+
+        k.kernel(iteration_mvp(0),soa,clip);
+
+        printf("         %.2fx aos, max error %g\n",rate/aos_rate,compare(clip,reference));
+    }
+
+    const char* name;
+    select_transform_kernel(&name);
+    clog<<"selected kernel: "<<name<<endl;
+
+    return 0;
+}
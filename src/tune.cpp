@@ -0,0 +1,210 @@
+#include "tune.h"
+#include "profile.h"
+
+#include <blaster/raster.h>
+#include <blaster/vector.h>
+#include <blaster/time.h>
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+struct Measurement
+{
+    double frame_us;
+
+    // work/(work+wait) of each kind of worker
+    double draw_load;
+    double update_load;
+};
+
+bool parse_worker_config(const char* text,WorkerConfig& config)
+{
+    WorkerConfig parsed;
+
+    if (text==nullptr or sscanf(text,"%d,%d",&parsed.draw_workers,&parsed.update_workers)!=2) {
+        return false;
+    }
+
+    if (parsed.draw_workers<1 or parsed.update_workers<1) {
+        return false;
+    }
+
+    config = parsed;
+
+    return true;
+}
+
+WorkerConfig default_worker_config(bool& tune)
+{
+    WorkerConfig config;
+    const char* env = getenv("BLASTER_WORKERS");
+
+    tune = (env and string(env)=="auto");
+
+    if (env and !tune and !parse_worker_config(env,config)) {
+        clog<<"Ignoring BLASTER_WORKERS="<<env<<", expected draw,update or auto"<<endl;
+    }
+
+    return config;
+}
+
+static Measurement measure(const WorkerConfig& config,int width,int height,const vector<Primitive*>& primitives,const View& view)
+{
+    bl_raster_t* raster = bl_raster_new(width,height,config.draw_workers,config.update_workers);
+
+    bl_vector_t light_pos = {0.0f,1.0f,4.0f,0.0f};
+    bl_vector_normalize(&light_pos);
+    bl_raster_uniform_set_vector(raster,2,&light_pos);
+
+    vector<double> times;
+    double work[2] = {0,0};
+    double busy[2] = {0,0};
+
+    for (int n=0;n<TUNE_WARMUP+TUNE_FRAMES;n++) {
+        DrawStats stats;
+        FrameRecord record;
+
+        auto t0 = std::chrono::steady_clock::now();
+
+        raster->start=bl_time_us();
+        bl_raster_clear(raster);
+        draw_primitives(raster,primitives,view,stats);
+        raster->main=bl_time_us();
+        bl_raster_flush_draw(raster);
+        bl_raster_flush_update(raster);
+
+        auto t1 = std::chrono::steady_clock::now();
+
+        record_workers(record,raster);
+
+        if (n<TUNE_WARMUP) {
+            continue;
+        }
+
+        times.push_back(std::chrono::duration_cast<std::chrono::microseconds>(t1-t0).count());
+
+        for (WorkerTime& wt : record.workers) {
+            int kind = (wt.type==1) ? 1 : 0;
+
+            work[kind]+=wt.work;
+            busy[kind]+=wt.work+wt.wait;
+        }
+    }
+
+    bl_raster_delete(raster);
+
+    Measurement m;
+
+    m.frame_us = compute_percentiles(times).p50;
+    m.draw_load = (busy[0]>0) ? work[0]/busy[0] : 0.0;
+    m.update_load = (busy[1]>0) ? work[1]/busy[1] : 0.0;
+
+    clog<<"tune "<<config.draw_workers<<","<<config.update_workers<<": "
+        <<m.frame_us/1000.0<<" ms, draw load "<<m.draw_load<<", update load "<<m.update_load<<endl;
+
+    return m;
+}
+
+static bool seen(const vector<WorkerConfig>& tried,const WorkerConfig& config)
+{
+    for (const WorkerConfig& other : tried) {
+        if (other.draw_workers==config.draw_workers and other.update_workers==config.update_workers) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void add_candidate(vector<WorkerConfig>& candidates,int draw_workers,int update_workers)
+{
+    if (draw_workers<1 or update_workers<1) {
+        return;
+    }
+
+    WorkerConfig config;
+    config.draw_workers = draw_workers;
+    config.update_workers = update_workers;
+
+    candidates.push_back(config);
+}
+
+WorkerConfig tune_workers(int width,int height,const vector<Primitive*>& primitives,const View& view)
+{
+    int threads = thread::hardware_concurrency();
+
+    if (threads<2) {
+        threads = 2;
+    }
+
+    WorkerConfig best;
+    best.update_workers = max(1,threads/4);
+    best.draw_workers = threads - best.update_workers;
+
+    vector<WorkerConfig> tried;
+    tried.push_back(best);
+
+    Measurement m = measure(best,width,height,primitives,view);
+
+    while ((int)tried.size()<TUNE_MAX_STEPS) {
+        int d = best.draw_workers;
+        int u = best.update_workers;
+
+        vector<WorkerConfig> candidates;
+
+        // shift a worker to the busier side first
+        if (m.update_load>m.draw_load) {
+            add_candidate(candidates,d-1,u+1);
+            add_candidate(candidates,d+1,u-1);
+        }
+        else {
+            add_candidate(candidates,d+1,u-1);
+            add_candidate(candidates,d-1,u+1);
+        }
+
+        // mostly waiting, fewer threads may contend less
+        if (m.draw_load<0.5) {
+            add_candidate(candidates,d-1,u);
+        }
+
+        if (m.update_load<0.5) {
+            add_candidate(candidates,d,u-1);
+        }
+
+        if (d+u<threads and m.draw_load>=0.5) {
+            add_candidate(candidates,d+1,u);
+        }
+
+        bool improved = false;
+
+        for (const WorkerConfig& config : candidates) {
+            if (seen(tried,config) or (int)tried.size()>=TUNE_MAX_STEPS) {
+                continue;
+            }
+
+            tried.push_back(config);
+            Measurement cm = measure(config,width,height,primitives,view);
+
+            // ignore differences within noise
+            if (cm.frame_us<m.frame_us*0.98) {
+                best = config;
+                m = cm;
+                improved = true;
+                break;
+            }
+        }
+
+        if (!improved) {
+            break;
+        }
+    }
+
+    return best;
+}
@@ -0,0 +1,37 @@
+#ifndef DEMO_TUNE_H
+#define DEMO_TUNE_H
+
+#include "mesh.h"
+#include "render.h"
+
+#include <vector>
+
+// frames rendered per candidate while tuning, after a short warmup
+#define TUNE_WARMUP 10
+#define TUNE_FRAMES 40
+
+// candidates tried before settling
+#define TUNE_MAX_STEPS 12
+
+struct WorkerConfig
+{
+    int draw_workers = 3;
+    int update_workers = 1;
+};
+
+// "D,U", both at least one
+bool parse_worker_config(const char* text,WorkerConfig& config);
+
+// $BLASTER_WORKERS when set and valid, else 3 draw and 1 update, tune is set for "auto"
+WorkerConfig default_worker_config(bool& tune);
+
+/*
+    Starts from hardware_concurrency threads split 3:1 between draw and
+    update workers and moves one worker at a time towards the side with the
+    higher work/(work+wait) ratio, dropping workers when both sides mostly
+    wait. Each candidate renders view on a fresh raster, the one with the
+    lowest median frame time is returned.
+*/
+WorkerConfig tune_workers(int width,int height,const std::vector<Primitive*>& primitives,const View& view);
+
+#endif
@@ -0,0 +1,211 @@
+#include <blaster/vector.h>
+#include <blaster/vbo.h>
+
+#include "loader.h"
+#include "layout.h"
+#include "pool.h"
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+struct VboBenchOptions
+{
+    const char* filename = nullptr;
+    int side = 1000;
+    int iterations = 20;
+};
+
+void usage()
+{
+    cerr<<"usage: blaster-vbo-bench [options] [model.gltf|model.glb|model.obj]"<<endl;
+    cerr<<"  --side N          vertices per side of the procedural grid (1000)"<<endl;
+    cerr<<"  --iterations N    builds per variant (20)"<<endl;
+}
+
+bool parse_options(VboBenchOptions& options,int argc,char* argv[])
+{
+    for (int n=1;n<argc;n++) {
+        string arg = argv[n];
+        bool has_value = (n+1)<argc;
+
+        if (arg=="--side" and has_value) {
+            options.side = atoi(argv[++n]);
+        }
+        else if (arg=="--iterations" and has_value) {
+            options.iterations = atoi(argv[++n]);
+        }
+        else if (arg[0]!='-' and options.filename==nullptr) {
+            options.filename = argv[n];
+        }
+        else {
+            return false;
+        }
+    }
+
+    return options.side>1 and options.iterations>0;
+}
+
+// side x side vertices, two triangles per cell
+void grid_mesh(int side,vector<Vertex>& vertices,vector<uint32_t>& indices)
+{
+    for (int y=0;y<side;y++) {
+        for (int x=0;x<side;x++) {
+            Vertex vertex;
+            vertex.p = {(float)x,(float)y,0.0f,1.0f};
+            vertex.n = {0.0f,0.0f,1.0f,0.0f};
+            vertex.t = {x/(float)side,y/(float)side};
+
+            vertices.push_back(vertex);
+        }
+    }
+
+    for (int y=0;y+1<side;y++) {
+        for (int x=0;x+1<side;x++) {
+            uint32_t a = y*side+x;
+            uint32_t b = a+1;
+            uint32_t c = b+side;
+            uint32_t d = a+side;
+
+            indices.insert(indices.end(),{a,b,c,a,c,d});
+        }
+    }
+}
+
+// the per vertex builders replaced by layout.h
+void legacy_indexed(bl_vbo_t* vbo,const vector<Vertex>& vertices,const vector<uint32_t>& indices)
+{
+    for (size_t n=0;n<indices.size();n++) {
+        bl_vbo_set_v(vbo,n,(void*)&vertices[indices[n]]);
+    }
+}
+
+void legacy_points(bl_vbo_t* vbo,const vector<Vertex>& vertices)
+{
+    struct point_t {
+        bl_vector_t p;
+        bl_color_t c;
+    };
+
+    for (size_t n=0;n<vertices.size();n++) {
+        struct point_t point = {};
+
+        point.p=vertices[n].p;
+
+        bl_vbo_set_v(vbo,n,&point);
+    }
+}
+
+double measure(const char* name,int iterations,size_t vertices,size_t stride,const std::function<void()>& build)
+{
+    // first touch of the vbo pages is not part of the build
+    build();
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    for (int i=0;i<iterations;i++) {
+        build();
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    double us = std::chrono::duration_cast<std::chrono::microseconds>(t1-t0).count();
+    double rate = vertices*(double)iterations/us;
+
+    printf("  %-16s %8.1f Mvertices/s %8.1f MB/s\n",name,rate,rate*stride);
+
+    return rate;
+}
+
+int main(int argc,char* argv[])
+{
+    VboBenchOptions options;
+
+    if (!parse_options(options,argc,argv)) {
+        usage();
+        return -1;
+    }
+
+    vector<Vertex> vertices;
+    vector<uint32_t> indices;
+
+    if (options.filename) {
+        vector<Primitive*> primitives;
+        BuildOptions build;
+
+        if (!load_primitives(options.filename,primitives,build)) {
+            cerr<<"Failed to load "<<options.filename<<endl;
+            return -1;
+        }
+
+        for (Primitive* prim : primitives) {
+            uint32_t base = vertices.size();
+
+            vertices.insert(vertices.end(),prim->vertices.begin(),prim->vertices.end());
+
+            for (uint32_t index : prim->indices) {
+                indices.push_back(base+index);
+            }
+
+            delete prim;
+        }
+    }
+    else {
+        grid_mesh(options.side,vertices,indices);
+    }
+
+    clog<<"vertices: "<<vertices.size()<<", indices: "<<indices.size()<<endl;
+
+    ThreadPool& pool = build_pool();
+
+    bl_vbo_t* legacy = new_vbo<TriangleLayout>(indices.size());
+    bl_vbo_t* typed = new_vbo<TriangleLayout>(indices.size());
+
+    printf("triangles, %zu byte stride\n",TriangleLayout::stride);
+
+    double before = measure("bl_vbo_set_v",options.iterations,indices.size(),TriangleLayout::stride,[&]() {
+        legacy_indexed(legacy,vertices,indices);
+    });
+
+    double gather = measure("gather_vbo",options.iterations,indices.size(),TriangleLayout::stride,[&]() {
+        gather_vbo<TriangleLayout>(typed,0,vertices.data(),indices.data(),indices.size());
+    });
+
+    double parallel = measure("gather_vbo pool",options.iterations,indices.size(),TriangleLayout::stride,[&]() {
+        parallel_for(pool,indices.size(),VBO_PARALLEL_GRAIN,[&](size_t begin,size_t end) {
+            gather_vbo<TriangleLayout>(typed,begin,vertices.data(),indices.data()+begin,end-begin);
+        });
+    });
+
+    bool same = memcmp(vbo_vertices<TriangleLayout,Vertex>(legacy),vbo_vertices<TriangleLayout,Vertex>(typed),indices.size()*TriangleLayout::stride)==0;
+
+    printf("  gather %.2fx, pool %.2fx bl_vbo_set_v, %s\n",gather/before,parallel/before,same ? "identical" : "MISMATCH");
+
+    bl_vbo_t* legacy_lines = new_vbo<LineLayout>(vertices.size());
+    bl_vbo_t* typed_lines = new_vbo<LineLayout>(vertices.size());
+
+    printf("points, %zu byte stride\n",LineLayout::stride);
+
+    before = measure("bl_vbo_set_v",options.iterations,vertices.size(),LineLayout::stride,[&]() {
+        legacy_points(legacy_lines,vertices);
+    });
+
+    double fill = measure("fill_vbo",options.iterations,vertices.size(),LineLayout::stride,[&]() {
+        fill_vbo<LineLayout,LineVertex>(typed_lines,0,vertices.size(),[&](size_t n) {
+            return LineVertex{vertices[n].p,{0,0,0,0}};
+        });
+    });
+
+    bool same_lines = memcmp(vbo_vertices<LineLayout,LineVertex>(legacy_lines),vbo_vertices<LineLayout,LineVertex>(typed_lines),vertices.size()*LineLayout::stride)==0;
+
+    printf("  fill %.2fx bl_vbo_set_v, %s\n",fill/before,same_lines ? "identical" : "MISMATCH");
+
+    return (same and same_lines) ? 0 : 1;
+}